@@ -0,0 +1,141 @@
+// AnalysisTrain.h
+// Runs several analyses over the Delphes files in one pass. The train reads
+// each entry once, through one LazyTreeReader, and hands the same TrainEvent
+// to every module: the branches, read by the first module that asks for
+// them, and the results more than one module needs, computed once per event.
+// For now that is the matching of the jets to the first dark quark and
+// antiquark (delta R < 0.04).
+//
+//   EmgDModule emgd(plots);  EffBModule effb(5, 0);
+//   std::vector<AnalysisModule*> modules;
+//   modules.push_back(&emgd);  modules.push_back(&effb);
+//   RunTrain(chain, modules);
+//
+// Modules ask for their branches in Init(); two modules using the same
+// branch get the same index and share the read.
+
+#ifndef ANALYSISTRAIN_H
+#define ANALYSISTRAIN_H
+
+#include "TChain.h"
+#include "TClonesArray.h"
+#include "classes/DelphesClasses.h"
+
+#include "DeltaRMatch.h"
+#include "LazyTreeReader.h"
+
+#include <iostream>
+#include <vector>
+
+class TrainEvent
+{
+public:
+  // the dark quark matches of a jet
+  enum { kDarkQuark = 1, kDarkAntiquark = 2 };
+
+  TrainEvent(LazyTreeReader &reader) : fReader(reader), fEntry(-1), fHaveDark(false), fHaveMatch(false)
+  {
+    fIParticle = reader.Use("Particle", "PID Eta Phi");
+    fIJet = reader.Use("Jet", "Eta Phi");
+  }
+
+  bool Load(Long64_t entry)
+  {
+    fEntry = entry;
+    fHaveDark = fHaveMatch = false;
+    return fReader.Load(entry);
+  }
+
+  Long64_t Entry() const { return fEntry; }
+  TClonesArray *Get(int ib) { return fReader.Get(ib); }
+
+  // the index of the first dark quark and antiquark in the Particle branch, -1 if none
+  int DarkQuark() { FindDarkQuarks(); return fDarkQuark; }
+  int DarkAntiquark() { FindDarkQuarks(); return fDarkAntiquark; }
+
+  // kDarkQuark | kDarkAntiquark for the jets within 0.04 of them
+  int DarkMatch(int ijet)
+  {
+    if(!fHaveMatch) {
+      FindDarkQuarks();
+      TClonesArray *jets = Get(fIJet);
+      TClonesArray *particles = Get(fIParticle);
+      int njet = jets->GetEntriesFast();
+      fMatch.assign(njet, 0);
+      int dark[2] = {fDarkQuark, fDarkAntiquark};
+      for(int k=0;k<2;k++) {
+        if(dark[k]<0) continue;
+        GenParticle *prt = (GenParticle*) particles->At(dark[k]);
+        for(int i=0;i<njet;i++) {
+          Jet *jet = (Jet*) jets->At(i);
+          if(DeltaR(jet->Eta, jet->Phi, prt->Eta, prt->Phi)<0.04) fMatch[i] |= 1<<k;
+        }
+      }
+      fHaveMatch = true;
+    }
+    return fMatch[ijet];
+  }
+
+private:
+  void FindDarkQuarks()
+  {
+    if(fHaveDark) return;
+    fDarkQuark = fDarkAntiquark = -1;
+    TClonesArray *particles = Get(fIParticle);
+    int ngn = particles->GetEntriesFast();
+    for(int i=0;i<ngn && (fDarkQuark<0 || fDarkAntiquark<0);i++) {
+      int id = ((GenParticle*) particles->At(i))->PID;
+      if(id==4900101 && fDarkQuark<0) fDarkQuark = i;
+      if(id==-4900101 && fDarkAntiquark<0) fDarkAntiquark = i;
+    }
+    fHaveDark = true;
+  }
+
+  LazyTreeReader &fReader;
+  Long64_t fEntry;
+  int fIParticle, fIJet;
+  bool fHaveDark, fHaveMatch;
+  int fDarkQuark, fDarkAntiquark;
+  std::vector<int> fMatch;
+};
+
+//------------------------------------------------------------------------------
+
+// the jet pt bins of the b tag efficiencies (effB.C, tuneTCBT.C)
+const int nJetPtBins = 16;
+const Double_t jetPtBins[nJetPtBins+1] = {20, 30, 40, 50, 60, 70, 80, 100, 120, 160, 210, 260, 320, 400, 500, 600, 800};
+
+class AnalysisModule
+{
+public:
+  virtual ~AnalysisModule() {}
+  // asks the reader for the branches and leaves the module reads
+  virtual void Init(LazyTreeReader &reader) = 0;
+  virtual void Process(TrainEvent &event) = 0;
+  // after the last entry
+  virtual void Finish() {}
+};
+
+// runs the modules over the entries [firstEntry, lastEntry) of the chain,
+// all of it by default
+inline void RunTrain(TChain *chain, const std::vector<AnalysisModule*> &modules,
+                     Long64_t firstEntry = 0, Long64_t lastEntry = -1)
+{
+  LazyTreeReader reader(chain);
+  TrainEvent event(reader);
+  for(size_t im=0;im<modules.size();im++) modules[im]->Init(reader);
+
+  if(lastEntry<0) {
+    lastEntry = reader.GetEntries();
+    std::cout << "** Chain contains " << lastEntry << " events" << std::endl;
+  }
+
+  for(Long64_t entry=firstEntry;entry<lastEntry;entry++) {
+    if(!event.Load(entry)) break;
+    for(size_t im=0;im<modules.size();im++) modules[im]->Process(event);
+  }
+
+  for(size_t im=0;im<modules.size();im++) modules[im]->Finish();
+}
+
+#endif // ANALYSISTRAIN_H
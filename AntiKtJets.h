@@ -0,0 +1,372 @@
+// AntiKtJets.h
+// Anti-kT clustering of a Pythia event on a (y,phi) grid of tiles, as done
+// by FastJet: the tiles are at least R wide, so the geometric nearest
+// neighbour of a particle is always found in the 3x3 tiles around it, and
+// the smallest distance is taken from a heap. This is close to N log N,
+// where SlowJet is N^2 to N^3 on the busy dark-shower events.
+//
+// The particle selection and the accessors follow SlowJet
+//   select 1: all final, 2: visible final, 3: charged final
+//   massSet 0: massless, 1: pion mass, 2: true mass
+// The jets are ordered in pT. Several jet collections with different
+// acceptance are taken from one clustering with JetView.
+
+#ifndef ANTIKTJETS_H
+#define ANTIKTJETS_H
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "Pythia8/Pythia.h"
+
+class AntiKtJets
+{
+public:
+  AntiKtJets(double R, double ptJetMin, double etaMax, int select = 2, int massSet = 1)
+    : fR(R), fR2(R*R), fPtJetMin(ptJetMin), fEtaMax(etaMax),
+      fSelect(select), fMassSet(massSet), fNY(0), fNPhi(0) {}
+
+  bool analyze(const Pythia8::Event &event)
+  {
+    fJets.clear();
+    fOrder.clear();
+    fPart.clear();
+    fInput.clear();
+
+    const double mPion = 0.13957;
+    for(int i=0;i<event.size();i++) {
+      const Pythia8::Particle &part = event[i];
+      if(!part.isFinal()) continue;
+      if(fSelect==2 && !part.isVisible()) continue;
+      if(fSelect==3 && !part.isCharged()) continue;
+      if(std::abs(part.eta())>fEtaMax) continue;
+      Pythia8::Vec4 p = part.p();
+      if(fMassSet<2) {
+        double m = (fMassSet==1) ? mPion : 0.;
+        p.e(std::sqrt(p.pAbs2()+m*m));
+      }
+      AddPseudoJet(p, fInput.size());
+      fInput.push_back(i);
+    }
+    fNext.assign(fPart.size(), -1);
+    Cluster();
+
+    // hardest first
+    for(size_t k=0;k<fJets.size();k++) fOrder.push_back(k);
+    std::sort(fOrder.begin(), fOrder.end(), ByPt(fPart, fJets));
+    return true;
+  }
+
+  int sizeJet() const { return fOrder.size(); }
+  double pT(int i) const { return Jet(i).pT; }
+  double y(int i) const { return Jet(i).y; }
+  double phi(int i) const { return Jet(i).phi; }
+  double m(int i) const { return Jet(i).p.mCalc(); }
+  Pythia8::Vec4 p(int i) const { return Jet(i).p; }
+  int multiplicity(int i) const { return Jet(i).mult; }
+
+  // event record indices of the particles in jet i
+  std::vector<int> constituents(int i) const
+  {
+    std::vector<int> out;
+    for(int k=Jet(i).head; k>=0; k=fNext[k]) out.push_back(fInput[k]);
+    return out;
+  }
+
+  void list() const
+  {
+    std::cout << "\n --------  AntiKtJets Listing  --------"
+              << "\n   no      pTjet      y       phi      mult" << std::endl;
+    for(int i=0;i<sizeJet();i++) {
+      std::cout << std::setw(5) << i << std::fixed << std::setprecision(3)
+                << std::setw(11) << pT(i) << std::setw(9) << y(i)
+                << std::setw(9) << phi(i) << std::setw(8) << multiplicity(i) << std::endl;
+    }
+    std::cout << " --------  End AntiKtJets Listing  ----" << std::endl;
+  }
+
+private:
+  struct PseudoJet {
+    Pythia8::Vec4 p;
+    double pT, pT2, y, phi;
+    int head, tail, mult;  // constituent list, linked through fNext
+    int tile, slot;        // place in the tile
+    int nn;                // geometric nearest neighbour within R, or -1
+    double nnDR2;
+    int version;           // changes whenever the heap entry gets stale
+    bool active;
+  };
+
+  struct HeapEntry {
+    double d;
+    int i, version;
+    bool operator<(const HeapEntry &o) const { return d>o.d; }
+  };
+
+  struct ByPt {
+    ByPt(const std::vector<PseudoJet> &part, const std::vector<int> &jets) : fP(part), fJ(jets) {}
+    bool operator()(int a, int b) const { return fP[fJ[a]].pT2>fP[fJ[b]].pT2; }
+    const std::vector<PseudoJet> &fP;
+    const std::vector<int> &fJ;
+  };
+
+  const PseudoJet &Jet(int i) const { return fPart[fJets[fOrder[i]]]; }
+
+  int AddPseudoJet(const Pythia8::Vec4 &p, int head)
+  {
+    PseudoJet pj;
+    pj.p = p;
+    pj.pT2 = p.pT2();
+    pj.pT = std::sqrt(pj.pT2);
+    pj.y = (pj.pT2>0.) ? p.rap() : (p.pz()>0. ? 1e10 : -1e10);
+    pj.phi = p.phi();
+    pj.head = pj.tail = head;
+    pj.mult = 1;
+    pj.tile = pj.slot = pj.nn = -1;
+    pj.nnDR2 = 1e300;
+    pj.version = 0;
+    pj.active = true;
+    fPart.push_back(pj);
+    return fPart.size()-1;
+  }
+
+  double DeltaR2(const PseudoJet &a, const PseudoJet &b) const
+  {
+    double dphi = std::abs(a.phi-b.phi);
+    if(dphi>M_PI) dphi = 2.*M_PI-dphi;
+    double dy = a.y-b.y;
+    return dy*dy+dphi*dphi;
+  }
+
+  // anti-kT: d_iB = 1/pT^2, d_ij = min(d_iB, d_jB) dR^2/R^2
+  double InvPt2(const PseudoJet &a) const { return a.pT2>0. ? 1./a.pT2 : 1e300; }
+  double Distance(int i) const
+  {
+    const PseudoJet &a = fPart[i];
+    double d = InvPt2(a);
+    if(a.nn>=0) d = std::min(d, InvPt2(fPart[a.nn]))*a.nnDR2/fR2;
+    return d;
+  }
+
+  void SetupTiles()
+  {
+    fNPhi = std::max(1, int(2.*M_PI/fR));
+    fTileY = fR;
+    double yMax = 0.;
+    for(size_t i=0;i<fPart.size();i++) {
+      if(std::abs(fPart[i].y)<1e9) yMax = std::max(yMax, std::abs(fPart[i].y));
+    }
+    int nY = std::max(1, int(2.*yMax/fTileY)+1);
+    fYMin = -0.5*nY*fTileY;
+    // the tiles keep their memory from event to event
+    if(fTiles.size()<(size_t)(nY*fNPhi)) fTiles.resize(nY*fNPhi);
+    for(size_t t=0;t<fTiles.size();t++) fTiles[t].clear();
+    if(nY==fNY && !fNeighbours.empty()) return;
+    fNY = nY;
+
+    // the 3x3 neighbourhood of every tile, each neighbour once
+    fNeighbours.assign(fNY*fNPhi, std::vector<int>());
+    for(int iy=0;iy<fNY;iy++) {
+      for(int ip=0;ip<fNPhi;ip++) {
+        std::vector<int> &nb = fNeighbours[iy*fNPhi+ip];
+        for(int dy=-1;dy<=1;dy++) {
+          if(iy+dy<0 || iy+dy>=fNY) continue;
+          for(int dp=-1;dp<=1;dp++) {
+            int t = (iy+dy)*fNPhi+(ip+dp+fNPhi)%fNPhi;
+            if(std::find(nb.begin(), nb.end(), t)==nb.end()) nb.push_back(t);
+          }
+        }
+      }
+    }
+  }
+
+  int TileOf(const PseudoJet &a) const
+  {
+    int iy = int(std::floor((a.y-fYMin)/fTileY));
+    iy = std::max(0, std::min(fNY-1, iy));
+    double phi = a.phi<0. ? a.phi+2.*M_PI : a.phi;
+    int ip = int(phi/(2.*M_PI)*fNPhi);
+    ip = std::max(0, std::min(fNPhi-1, ip));
+    return iy*fNPhi+ip;
+  }
+
+  void Insert(int i)
+  {
+    PseudoJet &a = fPart[i];
+    a.tile = TileOf(a);
+    a.slot = fTiles[a.tile].size();
+    fTiles[a.tile].push_back(i);
+  }
+
+  void Remove(int i)
+  {
+    PseudoJet &a = fPart[i];
+    std::vector<int> &t = fTiles[a.tile];
+    int last = t.back();
+    t[a.slot] = last;
+    fPart[last].slot = a.slot;
+    t.pop_back();
+    a.active = false;
+  }
+
+  void FindNN(int i)
+  {
+    PseudoJet &a = fPart[i];
+    a.nn = -1;
+    a.nnDR2 = fR2;  // partners beyond R never have the smallest distance
+    const std::vector<int> &nb = fNeighbours[a.tile];
+    for(size_t t=0;t<nb.size();t++) {
+      const std::vector<int> &tile = fTiles[nb[t]];
+      for(size_t k=0;k<tile.size();k++) {
+        int j = tile[k];
+        if(j==i) continue;
+        double dr2 = DeltaR2(a, fPart[j]);
+        if(dr2<a.nnDR2) { a.nnDR2 = dr2; a.nn = j; }
+      }
+    }
+  }
+
+  void Push(int i)
+  {
+    PseudoJet &a = fPart[i];
+    a.version++;
+    HeapEntry e = { Distance(i), i, a.version };
+    fHeap.push_back(e);
+    std::push_heap(fHeap.begin(), fHeap.end());
+  }
+
+  void Cluster()
+  {
+    fHeap.clear();
+    if(fPart.empty()) return;
+    SetupTiles();
+    int n = fPart.size();
+    fPart.reserve(2*n);  // n-1 recombinations at most
+    for(int i=0;i<n;i++) Insert(i);
+    for(int i=0;i<n;i++) FindNN(i);
+    for(int i=0;i<n;i++) Push(i);
+
+    std::vector<int> &touched = fTouched;
+    while(!fHeap.empty()) {
+      std::pop_heap(fHeap.begin(), fHeap.end());
+      HeapEntry e = fHeap.back();
+      fHeap.pop_back();
+      PseudoJet &a = fPart[e.i];
+      if(!a.active || e.version!=a.version) continue;
+
+      int i = e.i, j = a.nn, k = -1;
+      int tileI = a.tile, tileJ = -1;
+      if(j<0) {
+        // i goes to the beam
+        Remove(i);
+        if(a.pT>=fPtJetMin) fJets.push_back(i);
+      } else {
+        // recombine i and j into k, E-scheme; d_ij < d_iB whenever i has a neighbour
+        tileJ = fPart[j].tile;
+        Remove(i);
+        Remove(j);
+        k = AddPseudoJet(fPart[i].p+fPart[j].p, fPart[i].head);
+        fNext[fPart[i].tail] = fPart[j].head;
+        fPart[k].tail = fPart[j].tail;
+        fPart[k].mult = fPart[i].mult+fPart[j].mult;
+        Insert(k);
+        FindNN(k);
+        Push(k);
+      }
+
+      // neighbours that pointed to i or j, or are now closer to k
+      touched.clear();
+      int srcTiles[3] = { tileI, tileJ, k>=0 ? fPart[k].tile : -1 };
+      for(int s=0;s<3;s++) {
+        if(srcTiles[s]<0) continue;
+        const std::vector<int> &nb = fNeighbours[srcTiles[s]];
+        for(size_t t=0;t<nb.size();t++) {
+          if(std::find(touched.begin(), touched.end(), nb[t])!=touched.end()) continue;
+          touched.push_back(nb[t]);
+          const std::vector<int> &tile = fTiles[nb[t]];
+          for(size_t m=0;m<tile.size();m++) {
+            int l = tile[m];
+            if(l==k) continue;
+            PseudoJet &pl = fPart[l];
+            if(pl.nn==i || (j>=0 && pl.nn==j)) {
+              FindNN(l);
+              Push(l);
+            } else if(k>=0) {
+              double dr2 = DeltaR2(pl, fPart[k]);
+              if(dr2<pl.nnDR2) {
+                pl.nnDR2 = dr2;
+                pl.nn = k;
+                Push(l);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  double fR, fR2, fPtJetMin, fEtaMax;
+  int fSelect, fMassSet;
+
+  std::vector<PseudoJet> fPart;
+  std::vector<int> fInput;    // event index of the input particles
+  std::vector<int> fNext;     // constituent lists
+  std::vector<int> fJets;     // final jets, in order of clustering
+  std::vector<int> fOrder;    // fJets ordered in pT
+
+  int fNY, fNPhi;
+  double fYMin, fTileY;
+  std::vector<std::vector<int> > fTiles;
+  std::vector<std::vector<int> > fNeighbours;
+  std::vector<HeapEntry> fHeap;  // a heap with the smallest distance on top
+  std::vector<int> fTouched;
+};
+
+//------------------------------------------------------------------------------
+
+// the jets of an AntiKtJets clustering above ptMin and within |y|<yMax,
+// with the same accessors; Update() after every analyze() of the clustering
+class JetView
+{
+public:
+  JetView(const AntiKtJets &jets, double ptMin, double yMax = 1e10)
+    : fJets(jets), fPtMin(ptMin), fYMax(yMax) {}
+
+  void Update()
+  {
+    fIndex.clear();
+    for(int i=0;i<fJets.sizeJet();i++) {
+      if(fJets.pT(i)>=fPtMin && std::abs(fJets.y(i))<fYMax) fIndex.push_back(i);
+    }
+  }
+
+  int sizeJet() const { return fIndex.size(); }
+  double pT(int i) const { return fJets.pT(fIndex[i]); }
+  double y(int i) const { return fJets.y(fIndex[i]); }
+  double phi(int i) const { return fJets.phi(fIndex[i]); }
+  double m(int i) const { return fJets.m(fIndex[i]); }
+  Pythia8::Vec4 p(int i) const { return fJets.p(fIndex[i]); }
+  int multiplicity(int i) const { return fJets.multiplicity(fIndex[i]); }
+  std::vector<int> constituents(int i) const { return fJets.constituents(fIndex[i]); }
+
+  void list() const
+  {
+    std::cout << "\n --------  JetView Listing (pT > " << fPtMin << ", |y| < " << fYMax << ")  --------"
+              << "\n   no      pTjet      y       phi      mult" << std::endl;
+    for(int i=0;i<sizeJet();i++) {
+      std::cout << std::setw(5) << i << std::fixed << std::setprecision(3)
+                << std::setw(11) << pT(i) << std::setw(9) << y(i)
+                << std::setw(9) << phi(i) << std::setw(8) << multiplicity(i) << std::endl;
+    }
+  }
+
+private:
+  const AntiKtJets &fJets;
+  double fPtMin, fYMax;
+  std::vector<int> fIndex;
+};
+
+#endif // ANTIKTJETS_H
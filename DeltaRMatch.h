@@ -0,0 +1,265 @@
+// DeltaRMatch.h
+// Delta-R matching between collections of objects (jets, partons, dark
+// pions, tracks), shared by pythiaTree and emgD.C.
+//
+// The objects are kept as structure of arrays (eta or y, phi, pT), and the
+// kernels run over one contiguous row without branches, so the compiler
+// vectorizes them. The squared distance is compared with R^2, so no square
+// root is taken inside the loops.
+//
+//   EtaPhiPoints trks;  trks.push_back(eta, phi, pt);
+//   WithinCone(jetEta, jetPhi, trks, 0.4, inCone);  // indices, ascending
+//   int k = NearestMatch(eta, phi, jets, dR);       // -1 if jets is empty
+
+#ifndef DELTARMATCH_H
+#define DELTARMATCH_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+class EtaPhiPoints
+{
+public:
+  void clear() { eta.clear(); phi.clear(); pt.clear(); }
+  void reserve(size_t n) { eta.reserve(n); phi.reserve(n); pt.reserve(n); }
+  void push_back(float e, float p, float t = 0.) { eta.push_back(e); phi.push_back(p); pt.push_back(t); }
+  size_t size() const { return eta.size(); }
+
+  std::vector<float> eta;  // or rapidity, as long as both sides use the same
+  std::vector<float> phi;
+  std::vector<float> pt;
+};
+
+//------------------------------------------------------------------------------
+
+inline float DeltaR(float eta1, float phi1, float eta2, float phi2)
+{
+  const float kPi = 3.14159265f;
+  float deta = eta1-eta2;
+  float dphi = std::fabs(phi1-phi2);
+  if(dphi>kPi) dphi = 2.f*kPi-dphi;
+  return std::sqrt(deta*deta+dphi*dphi);
+}
+
+// squared delta R from (eta,phi) to n points
+inline void DeltaR2Block(float eta, float phi, const float *be, const float *bp,
+                         size_t n, float *dr2)
+{
+  const float kPi = 3.14159265f;
+  for(size_t j=0;j<n;j++) {
+    float deta = eta-be[j];
+    float dphi = std::fabs(phi-bp[j]);
+    dphi = std::min(dphi, 2.f*kPi-dphi);  // the wrap of DeltaR(), without a branch
+    dr2[j] = deta*deta+dphi*dphi;
+  }
+}
+
+// squared delta R from (eta,phi) to every point of b
+inline void DeltaR2Row(float eta, float phi, const EtaPhiPoints &b, std::vector<float> &dr2)
+{
+  dr2.resize(b.size());
+  if(b.size()>0) DeltaR2Block(eta, phi, &b.eta[0], &b.phi[0], b.size(), &dr2[0]);
+}
+
+// the rows are done in blocks on the stack
+const size_t kDeltaRBlock = 256;
+
+// indices of the points of b with delta R < R, in ascending order
+inline void WithinCone(float eta, float phi, const EtaPhiPoints &b, float R,
+                       std::vector<int> &idx)
+{
+  float dr2[kDeltaRBlock];
+  float R2 = R*R;
+  idx.clear();
+  for(size_t j0=0;j0<b.size();j0+=kDeltaRBlock) {
+    size_t n = std::min(kDeltaRBlock, b.size()-j0);
+    DeltaR2Block(eta, phi, &b.eta[j0], &b.phi[j0], n, dr2);
+    for(size_t j=0;j<n;j++) {
+      if(dr2[j]<R2) idx.push_back(j0+j);
+    }
+  }
+}
+
+inline int CountWithinCone(float eta, float phi, const EtaPhiPoints &b, float R)
+{
+  float dr2[kDeltaRBlock];
+  float R2 = R*R;
+  int count = 0;
+  for(size_t j0=0;j0<b.size();j0+=kDeltaRBlock) {
+    size_t n = std::min(kDeltaRBlock, b.size()-j0);
+    DeltaR2Block(eta, phi, &b.eta[j0], &b.phi[j0], n, dr2);
+    for(size_t j=0;j<n;j++) count += (dr2[j]<R2);
+  }
+  return count;
+}
+
+// the closest point of b (the first one on a tie) and its delta R;
+// -1 and dR unchanged if b is empty
+inline int NearestMatch(float eta, float phi, const EtaPhiPoints &b, float &dR)
+{
+  float dr2[kDeltaRBlock];
+  int best = -1;
+  float bestDR2 = 0.;
+  for(size_t j0=0;j0<b.size();j0+=kDeltaRBlock) {
+    size_t n = std::min(kDeltaRBlock, b.size()-j0);
+    DeltaR2Block(eta, phi, &b.eta[j0], &b.phi[j0], n, dr2);
+    for(size_t j=0;j<n;j++) {
+      if(best<0 || dr2[j]<bestDR2) { best = j0+j; bestDR2 = dr2[j]; }
+    }
+  }
+  if(best>=0) dR = std::sqrt(bestDR2);
+  return best;
+}
+
+// for every point of a, the nearest point of b (-1 if none) and its delta R
+inline void NearestMatches(const EtaPhiPoints &a, const EtaPhiPoints &b,
+                           std::vector<int> &idx, std::vector<float> &dR)
+{
+  idx.assign(a.size(), -1);
+  dR.assign(a.size(), 99999.);
+  for(size_t i=0;i<a.size();i++) idx[i] = NearestMatch(a.eta[i], a.phi[i], b, dR[i]);
+}
+
+// for every point of a, the points of b within R, in ascending order
+inline void ConeMap(const EtaPhiPoints &a, const EtaPhiPoints &b, float R,
+                    std::vector<std::vector<int> > &idx)
+{
+  idx.resize(a.size());
+  for(size_t i=0;i<a.size();i++) WithinCone(a.eta[i], a.phi[i], b, R, idx[i]);
+}
+
+//------------------------------------------------------------------------------
+
+// The indices of a collection binned in eta and phi, with cells at least R
+// wide, so a cone of radius R only visits the 3x3 cells around its axis.
+// The eta range is fixed (|eta| < kEtaRange, anything beyond goes to the
+// edge cells), so building is two passes over the points and no more.
+// Inside a cell the points stay in index order, and the distances come
+// from the same kernel as above, so WithinCone gives the same indices as
+// the flat version.
+//
+//   EtaPhiGrid grid;  grid.Build(trks, 0.4);      // once per event
+//   WithinCone(jetEta, jetPhi, grid, 0.4, inCone);
+class EtaPhiGrid
+{
+public:
+  static constexpr float kEtaRange = 5.f;
+
+  EtaPhiGrid() : fPts(0), fR(0.), fNEta(1), fNPhi(1), fEtaScale(0.), fPhiScale(0.) {}
+
+  void Build(const EtaPhiPoints &pts, float R)
+  {
+    const float kPi = 3.14159265f;
+    fPts = &pts;
+    fR = R;
+    // the small margin keeps the cells wider than R after rounding
+    fNEta = std::max(1, int(2.f*kEtaRange/(1.001f*R)));
+    fNPhi = int(2.f*kPi/(1.001f*R));
+    if(fNPhi<3) fNPhi = 1;  // too few cells to skip any
+    fEtaScale = fNEta/(2.f*kEtaRange);
+    fPhiScale = fNPhi/(2.f*kPi);
+
+    size_t n = pts.size();
+    fCellOf.resize(n);
+    // locals, so the loop vectorizes
+    int *cellOf = n>0 ? &fCellOf[0] : 0;
+    const float *eta = n>0 ? &pts.eta[0] : 0, *phi = n>0 ? &pts.phi[0] : 0;
+    int nPhi = fNPhi;
+    float etaMax = fNEta-1.f, phiMax = fNPhi-1.f, etaScale = fEtaScale, phiScale = fPhiScale;
+    for(size_t i=0;i<n;i++) {
+      float x = std::min(std::max((eta[i]+kEtaRange)*etaScale, 0.f), etaMax);
+      float y = std::min(std::max((phi[i]+kPi)*phiScale, 0.f), phiMax);
+      cellOf[i] = int(x)*nPhi+int(y);
+    }
+
+    // counting sort on the cell, stable so each cell stays in index order
+    fCellStart.assign(fNEta*fNPhi+1, 0);
+    for(size_t i=0;i<n;i++) fCellStart[fCellOf[i]+1]++;
+    for(int c=0;c<fNEta*fNPhi;c++) fCellStart[c+1] += fCellStart[c];
+    fFill.assign(fCellStart.begin(), fCellStart.end()-1);
+    fIndex.resize(n);
+    for(size_t i=0;i<n;i++) fIndex[fFill[fCellOf[i]]++] = i;
+  }
+
+  const EtaPhiPoints &Points() const { return *fPts; }
+  float R() const { return fR; }
+
+  // calls f(k0, k1) for the runs [k0,k1) of Index() that can be within R of
+  // (eta,phi); all of them if R is larger than the cells
+  template<class F>
+  void ForNeighbourCells(float eta, float phi, float R, F f) const
+  {
+    if(fIndex.empty()) return;
+    if(R>fR) {
+      f(0, int(fIndex.size()));
+      return;
+    }
+    int ie = EtaBin(eta), ip = PhiBin(phi);
+    int ie0 = std::max(ie-1, 0), ie1 = std::min(ie+1, fNEta-1);
+    for(int je=ie0;je<=ie1;je++) {
+      if(fNPhi==1) {
+        Run(je*fNPhi, f);
+      } else {
+        for(int d=-1;d<=1;d++) Run(je*fNPhi+(ip+d+fNPhi)%fNPhi, f);
+      }
+    }
+  }
+
+  int Index(int k) const { return fIndex[k]; }
+
+private:
+  // as in Build(); clamping never moves two points further apart, so
+  // neighbours stay neighbours
+  int EtaBin(float eta) const
+  {
+    float x = (eta+kEtaRange)*fEtaScale;
+    return int(std::min(std::max(x, 0.f), fNEta-1.f));
+  }
+  int PhiBin(float phi) const
+  {
+    const float kPi = 3.14159265f;
+    float x = (phi+kPi)*fPhiScale;
+    return int(std::min(std::max(x, 0.f), fNPhi-1.f));
+  }
+
+  template<class F>
+  void Run(int c, F &f) const
+  {
+    if(fCellStart[c+1]>fCellStart[c]) f(fCellStart[c], fCellStart[c+1]);
+  }
+
+  const EtaPhiPoints *fPts;
+  float fR;
+  int fNEta, fNPhi;
+  float fEtaScale, fPhiScale;  // cells per unit
+  std::vector<int> fCellOf, fCellStart, fFill;
+  std::vector<int> fIndex;  // point indices in cell order
+};
+
+// as WithinCone above, visiting only the cells around (eta,phi)
+inline void WithinCone(float eta, float phi, const EtaPhiGrid &grid, float R,
+                       std::vector<int> &idx)
+{
+  float be[kDeltaRBlock], bp[kDeltaRBlock], dr2[kDeltaRBlock];
+  float R2 = R*R;
+  const EtaPhiPoints &pts = grid.Points();
+  idx.clear();
+  grid.ForNeighbourCells(eta, phi, R, [&](int k0, int k1) {
+    for(int j0=k0;j0<k1;j0+=kDeltaRBlock) {
+      int n = std::min(int(kDeltaRBlock), k1-j0);
+      for(int j=0;j<n;j++) {
+        be[j] = pts.eta[grid.Index(j0+j)];
+        bp[j] = pts.phi[grid.Index(j0+j)];
+      }
+      DeltaR2Block(eta, phi, be, bp, n, dr2);
+      for(int j=0;j<n;j++) {
+        if(dr2[j]<R2) idx.push_back(grid.Index(j0+j));
+      }
+    }
+  });
+  std::sort(idx.begin(), idx.end());
+}
+
+#endif // DELTARMATCH_H
@@ -0,0 +1,177 @@
+// EventGraph.h
+// Mother/daughter index of a Pythia event record, built once per event in
+// linear time. Daughters and mothers are stored as compressed rows (CSR),
+// so walking a decay tree costs only the size of the answer.
+//
+// The daughters of particle i are daughter1()..daughter2(), if daughter1()
+// is non-zero; this is the convention the decay-tree code of pythiaTree
+// has always used. A particle is stable if daughter1() is zero.
+
+#ifndef EVENTGRAPH_H
+#define EVENTGRAPH_H
+
+#include <vector>
+#include <algorithm>
+
+#include "Pythia8/Pythia.h"
+
+class EventGraph
+{
+public:
+  EventGraph() : fSize(0), fStamp(0) {}
+
+  void Build(const Pythia8::Event &event)
+  {
+    fSize = event.size();
+    fDauStart.assign(fSize+1, 0);
+    fMomStart.assign(fSize+1, 0);
+    fStable.resize(fSize);
+
+    // count, then fill the daughter rows; mothers are the reversed edges
+    for(int i=0;i<fSize;i++) {
+      int d1 = event[i].daughter1();
+      int d2 = event[i].daughter2();
+      fStable[i] = (d1==0);
+      int nd = (d1!=0 && d2>=d1) ? d2-d1+1 : 0;
+      fDauStart[i+1] = fDauStart[i] + nd;
+      for(int d=d1; d<d1+nd; d++) {
+        if(d>=0 && d<fSize) fMomStart[d+1]++;
+      }
+    }
+    for(int i=0;i<fSize;i++) fMomStart[i+1] += fMomStart[i];
+
+    fDau.resize(fDauStart[fSize]);
+    fMom.resize(fMomStart[fSize]);
+    fFill.assign(fMomStart.begin(), fMomStart.end()-1);
+    for(int i=0;i<fSize;i++) {
+      int d1 = event[i].daughter1();
+      int k = fDauStart[i];
+      for(int d=d1; k<fDauStart[i+1]; d++, k++) {
+        // daughters outside the record are kept out of the graph
+        fDau[k] = (d>=0 && d<fSize) ? d : -1;
+        if(fDau[k]>=0) fMom[fFill[d]++] = i;
+      }
+    }
+
+    BuildTopoOrder();
+
+    if(fVisit.size()<(size_t)fSize) fVisit.resize(fSize, 0);
+  }
+
+  int size() const { return fSize; }
+  bool IsStable(int i) const { return fStable[i]; }
+
+  // daughters of i are fDau[DaughterBegin(i)..DaughterEnd(i)), skip entries <0
+  int NDaughters(int i) const { return fDauStart[i+1]-fDauStart[i]; }
+  const int *DaughterBegin(int i) const { return fDau.empty() ? 0 : &fDau[0]+fDauStart[i]; }
+  const int *DaughterEnd(int i) const { return fDau.empty() ? 0 : &fDau[0]+fDauStart[i+1]; }
+  const int *MotherBegin(int i) const { return fMom.empty() ? 0 : &fMom[0]+fMomStart[i]; }
+  const int *MotherEnd(int i) const { return fMom.empty() ? 0 : &fMom[0]+fMomStart[i+1]; }
+
+  // every particle after all of its mothers
+  const std::vector<int> &TopoOrder() const { return fTopo; }
+
+  // start a new visited set; O(1)
+  void NewSearch()
+  {
+    fStamp++;
+    if(fStamp==0) {  // wrapped around, clear the marks once
+      std::fill(fVisit.begin(), fVisit.end(), 0);
+      fStamp = 1;
+    }
+  }
+  bool Visited(int i) const { return fVisit[i]==fStamp; }
+
+  // append root (if not visited yet) and its descendants, breadth first, to out.
+  // Only daughters for which follow(daughter) is true are added and walked.
+  template<class Pred>
+  void Collect(int root, std::vector<int> &out, Pred follow)
+  {
+    if(Visited(root)) return;
+    fVisit[root] = fStamp;
+    size_t first = out.size();
+    out.push_back(root);
+    for(size_t k=first; k<out.size(); k++) {
+      int i = out[k];
+      for(const int *d=DaughterBegin(i); d!=DaughterEnd(i); ++d) {
+        if(*d<0 || Visited(*d) || !follow(*d)) continue;
+        fVisit[*d] = fStamp;
+        out.push_back(*d);
+      }
+    }
+  }
+
+  // all descendants of i (not i itself), breadth first, each once
+  void Descendants(int i, std::vector<int> &out)
+  {
+    out.clear();
+    NewSearch();
+    fVisit[i] = fStamp;
+    for(size_t k=0, j=i; ; j=out[k++]) {
+      for(const int *d=DaughterBegin(j); d!=DaughterEnd(j); ++d) {
+        if(*d<0 || Visited(*d)) continue;
+        fVisit[*d] = fStamp;
+        out.push_back(*d);
+      }
+      if(k==out.size()) break;
+    }
+  }
+
+  // stable descendants of i, in the order of Descendants()
+  void StableDescendants(int i, std::vector<int> &out)
+  {
+    Descendants(i, fScratch);
+    out.clear();
+    for(size_t k=0;k<fScratch.size();k++) {
+      if(fStable[fScratch[k]]) out.push_back(fScratch[k]);
+    }
+  }
+
+  // all ancestors of i (not i itself), each once
+  void Ancestors(int i, std::vector<int> &out)
+  {
+    out.clear();
+    NewSearch();
+    fVisit[i] = fStamp;
+    for(size_t k=0, j=i; ; j=out[k++]) {
+      for(const int *m=MotherBegin(j); m!=MotherEnd(j); ++m) {
+        if(Visited(*m)) continue;
+        fVisit[*m] = fStamp;
+        out.push_back(*m);
+      }
+      if(k==out.size()) break;
+    }
+  }
+
+private:
+  // Kahn's algorithm on the daughter edges; anything left on a cycle
+  // (not expected in a valid record) is appended at the end
+  void BuildTopoOrder()
+  {
+    fTopo.clear();
+    fIndeg.assign(fSize, 0);
+    for(size_t k=0;k<fDau.size();k++) if(fDau[k]>=0) fIndeg[fDau[k]]++;
+    for(int i=0;i<fSize;i++) if(fIndeg[i]==0) fTopo.push_back(i);
+    for(size_t k=0;k<fTopo.size();k++) {
+      int i = fTopo[k];
+      for(const int *d=DaughterBegin(i); d!=DaughterEnd(i); ++d) {
+        if(*d>=0 && --fIndeg[*d]==0) fTopo.push_back(*d);
+      }
+    }
+    if((int)fTopo.size()<fSize) {
+      for(int i=0;i<fSize;i++) if(fIndeg[i]>0) fTopo.push_back(i);
+    }
+  }
+
+  int fSize;
+  std::vector<int> fDauStart, fDau;
+  std::vector<int> fMomStart, fMom;
+  std::vector<int> fFill, fIndeg;
+  std::vector<int> fTopo;
+  std::vector<bool> fStable;
+  std::vector<unsigned> fVisit;
+  unsigned fStamp;
+  std::vector<int> fScratch;
+};
+
+#endif // EVENTGRAPH_H
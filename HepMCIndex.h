@@ -0,0 +1,181 @@
+// HepMCIndex.h
+// Index of a block-compressed HepMC file, for reading any range of events
+// without decompressing the file from the start.
+//
+// The gzip output of HepMCOutput.h and of hepmcIndex.exe is a sequence of
+// gzip members, each holding whole IO_GenEvent events (the first one also
+// the header, the last one also the footer). The index, [file].idx, has one
+// line per member:
+//   offset size firstEvent nEvents
+// with the offset and size of the member in the file. A range of events is
+// read by inflating only the members that hold it, so several DelphesHepMC
+// can work on one file at the same time:
+//   hepmcIndex.exe extract ttbar.hepmc.gz 0 5000 | DelphesHepMC card.tcl part0.root
+
+#ifndef HEPMCINDEX_H
+#define HEPMCINDEX_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+struct HepMCBlock
+{
+  long long offset;
+  long long size;
+  long long firstEvent;
+  long long nEvents;
+};
+
+// the number of events starting in the text: lines beginning with "E "
+inline long long CountHepMCEvents(const char *data, size_t size)
+{
+  long long n = 0;
+  for(size_t i=0;i+1<size;i++) {
+    if(data[i]=='E' && data[i+1]==' ' && (i==0 || data[i-1]=='\n')) n++;
+  }
+  return n;
+}
+
+// one complete gzip member
+inline bool GzipBlock(const char *in, size_t size, int level, std::vector<char> &out)
+{
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  out.clear();
+  if(deflateInit2(&zs, level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY)!=Z_OK) return false;
+  out.resize(deflateBound(&zs, size)+32);
+  zs.next_in = (Bytef*) in;
+  zs.avail_in = size;
+  zs.next_out = (Bytef*) &out[0];
+  zs.avail_out = out.size();
+  int ret = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return ret==Z_STREAM_END;
+}
+
+inline bool GunzipBlock(const std::vector<char> &in, std::string &out)
+{
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  zs.next_in = Z_NULL;
+  zs.avail_in = 0;
+  out.clear();
+  if(in.empty() || inflateInit2(&zs, 15+16)!=Z_OK) return false;
+  zs.next_in = (Bytef*) &in[0];
+  zs.avail_in = in.size();
+  char chunk[1<<16];
+  int ret;
+  do {
+    zs.next_out = (Bytef*) chunk;
+    zs.avail_out = sizeof(chunk);
+    ret = inflate(&zs, Z_NO_FLUSH);
+    if(ret!=Z_OK && ret!=Z_STREAM_END) break;
+    out.append(chunk, sizeof(chunk)-zs.avail_out);
+  } while(ret!=Z_STREAM_END);
+  inflateEnd(&zs);
+  return ret==Z_STREAM_END;
+}
+
+//------------------------------------------------------------------------------
+
+class HepMCIndex
+{
+public:
+  static std::string IndexName(const std::string &file) { return file+".idx"; }
+
+  bool Read(const std::string &file)
+  {
+    fBlocks.clear();
+    FILE *in = fopen(IndexName(file).c_str(), "r");
+    if(!in) return false;
+    HepMCBlock b;
+    while(fscanf(in, "%lld %lld %lld %lld", &b.offset, &b.size, &b.firstEvent, &b.nEvents)==4) fBlocks.push_back(b);
+    fclose(in);
+    return !fBlocks.empty();
+  }
+
+  // the blocks completely within the first size bytes of the file (resumed output)
+  void Truncate(long long size)
+  {
+    while(!fBlocks.empty() && fBlocks.back().offset+fBlocks.back().size>size) fBlocks.pop_back();
+  }
+
+  bool Write(FILE *out) const
+  {
+    for(size_t ib=0;ib<fBlocks.size();ib++) WriteBlock(out, fBlocks[ib]);
+    return fflush(out)==0;
+  }
+
+  static void WriteBlock(FILE *out, const HepMCBlock &b)
+  {
+    fprintf(out, "%lld %lld %lld %lld\n", b.offset, b.size, b.firstEvent, b.nEvents);
+  }
+
+  const std::vector<HepMCBlock> &Blocks() const { return fBlocks; }
+  std::vector<HepMCBlock> &Blocks() { return fBlocks; }
+  long long NEvents() const { return fBlocks.empty() ? 0 : fBlocks.back().firstEvent+fBlocks.back().nEvents; }
+  long long Size() const { return fBlocks.empty() ? 0 : fBlocks.back().offset+fBlocks.back().size; }
+
+  // writes the events [first, last) of the file to out as a complete
+  // IO_GenEvent stream, with the header of the file and the footer
+  bool Extract(const std::string &file, long long first, long long last, FILE *out) const
+  {
+    if(fBlocks.empty()) return false;
+    if(last<0 || last>NEvents()) last = NEvents();
+    FILE *in = fopen(file.c_str(), "rb");
+    if(!in) return false;
+    std::string text;
+    bool ok = ReadBlock(in, fBlocks[0], text);
+    // the header is what comes before the first event
+    size_t start = ok ? FirstEvent(text) : 0;
+    fwrite(text.data(), 1, start, out);
+    for(size_t ib=0;ib<fBlocks.size() && ok;ib++) {
+      const HepMCBlock &b = fBlocks[ib];
+      if(b.firstEvent+b.nEvents<=first || b.firstEvent>=last || b.nEvents==0) continue;
+      if(ib>0) ok = ReadBlock(in, b, text);
+      if(!ok) break;
+      long long ie = b.firstEvent-1;
+      size_t pos = FirstEvent(text);
+      while(pos<text.size()) {
+        size_t end = text.find('\n', pos);
+        end = end==std::string::npos ? text.size() : end+1;
+        if(text.compare(pos, 2, "E ")==0) ie++;
+        if(ie>=last) break;
+        // the footer is written once at the end
+        if(ie>=first && text.compare(pos, 7, "HepMC::")!=0) fwrite(text.data()+pos, 1, end-pos, out);
+        pos = end;
+      }
+    }
+    fclose(in);
+    fputs("HepMC::IO_GenEvent-END_EVENT_LISTING\n", out);
+    return ok && fflush(out)==0;
+  }
+
+private:
+  static bool ReadBlock(FILE *in, const HepMCBlock &b, std::string &text)
+  {
+    std::vector<char> packed(b.size);
+    if(fseeko(in, b.offset, SEEK_SET)!=0 || fread(&packed[0], 1, b.size, in)!=(size_t) b.size) return false;
+    return GunzipBlock(packed, text);
+  }
+
+  static size_t FirstEvent(const std::string &text)
+  {
+    if(text.compare(0, 2, "E ")==0) return 0;
+    size_t pos = text.find("\nE ");
+    return pos==std::string::npos ? text.size() : pos+1;
+  }
+
+  std::vector<HepMCBlock> fBlocks;
+};
+
+#endif // HEPMCINDEX_H
@@ -0,0 +1,370 @@
+// HepMCOutput.h
+// Output of the HepMC event stream for pythiaTree and pythiaBlank.
+//
+// The text written by HepMC::IO_GenEvent is collected in large blocks, and a
+// background thread writes the blocks out, so the generator never waits for
+// the disk. The output can be
+//   ascii : plain IO_GenEvent text, as read by DelphesHepMC
+//   gzip  : every block is compressed as its own gzip member; the members
+//           together form a normal .gz file, read with
+//           gunzip -c hepmc.out.gz | DelphesHepMC card.tcl out.root
+//           The blocks hold whole events, and hepmc.out.gz.idx indexes them
+//           (see HepMCIndex.h), so event ranges can be read in parallel
+//   none  : no output
+// A file name of "-" streams to stdout (e.g. straight into DelphesHepMC);
+// the normal printout of the program is then moved to stderr.
+// A job resumed from a checkpoint cuts the file back to the size at the
+// checkpoint (Offset()) and appends to it, without a second header.
+//
+// Selected from the card with
+//   Main:hepmcOutput = ascii
+//   Main:hepmcFile = hepmc.out
+//   Main:hepmcCompression = 6
+
+#ifndef HEPMCOUTPUT_H
+#define HEPMCOUTPUT_H
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "Pythia8/Pythia.h"
+#include "Pythia8Plugins/HepMC2.h"
+#include "HepMC/StreamInfo.h"
+#include "HepMCIndex.h"
+
+// the settings must be declared before the card is read
+inline void AddHepMCOutputSettings(Pythia8::Settings &settings)
+{
+  settings.addWord("Main:hepmcOutput","ascii");
+  settings.addWord("Main:hepmcFile","hepmc.out");
+  settings.addMode("Main:hepmcCompression",6,true,true,1,9);
+}
+
+//------------------------------------------------------------------------------
+
+class AsyncBlockBuf : public std::streambuf
+{
+public:
+  // level 0 writes the blocks as they are
+  AsyncBlockBuf(FILE *out, int level, size_t blockSize = 4<<20, size_t maxQueued = 4)
+    : fOut(out), fLevel(level), fBlockSize(blockSize), fMaxQueued(maxQueued),
+      fBusy(false), fStop(false), fFailed(false), fBytesOut(0), fIndex(0)
+  {
+    fBlock.resize(fBlockSize);
+    setp(&fBlock[0], &fBlock[0]+fBlockSize);
+    fThread = std::thread(&AsyncBlockBuf::Run, this);
+  }
+
+  ~AsyncBlockBuf() { Close(); }
+
+  // hand over the current block and wait until everything is on disk
+  void Flush()
+  {
+    HandOver();
+    std::unique_lock<std::mutex> lock(fMutex);
+    fDone.wait(lock, [&]{ return fQueue.empty() && !fBusy; });
+    fflush(fOut);
+  }
+
+  void Close()
+  {
+    if(!fThread.joinable()) return;
+    HandOver();
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fStop = true;
+    }
+    fReady.notify_all();
+    fThread.join();
+    fflush(fOut);
+  }
+
+  // bytes written to the output so far (compressed size for gzip)
+  long long BytesOut()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return fBytesOut;
+  }
+
+  bool Failed() const { return fFailed; }
+
+  // index every block written from now on, the first at offset in the file
+  // and starting with event firstEvent. Before anything is handed over.
+  void SetIndex(FILE *index, long long offset, long long firstEvent)
+  {
+    fIndex = index;
+    fIndexBlock.offset = offset;
+    fIndexBlock.firstEvent = firstEvent;
+  }
+
+protected:
+  // the blocks end where an event starts, so each holds whole events; a
+  // single event longer than the block makes the block grow
+  int_type overflow(int_type c)
+  {
+    char *start = LastEventStart();
+    if(start) {
+      HandOver(start);
+    } else {
+      size_t n = pptr()-pbase();
+      fBlock.resize(2*fBlock.size());
+      setp(&fBlock[0], &fBlock[0]+fBlock.size());
+      pbump(n);
+    }
+    if(c!=traits_type::eof()) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  // the ostream is flushed after every event by some writers; keep collecting
+  int sync() { return 0; }
+
+private:
+  // the beginning of the last "E " line, if not at the start of the block
+  char *LastEventStart()
+  {
+    for(char *p=pptr()-2;p>pbase();p--) {
+      if(p[0]=='E' && p[1]==' ' && p[-1]=='\n') return p;
+    }
+    return 0;
+  }
+
+  // the block up to end goes to the writer, the rest starts the next one
+  void HandOver(char *end = 0)
+  {
+    if(!end) end = pptr();
+    size_t n = end-pbase();
+    if(n==0) return;
+    std::vector<char> rest(end, pptr());
+    fBlock.resize(n);
+    {
+      std::unique_lock<std::mutex> lock(fMutex);
+      // backpressure: do not run away from the writer thread
+      fDone.wait(lock, [&]{ return fQueue.size()<fMaxQueued; });
+      fQueue.push_back(std::vector<char>());
+      fQueue.back().swap(fBlock);
+    }
+    fReady.notify_all();
+    fBlock.resize(std::max(fBlockSize, 2*rest.size()));
+    setp(&fBlock[0], &fBlock[0]+fBlock.size());
+    if(!rest.empty()) {
+      std::copy(rest.begin(), rest.end(), fBlock.begin());
+      pbump(rest.size());
+    }
+  }
+
+  void Run()
+  {
+    std::vector<char> block, packed;
+    while(true) {
+      {
+        std::unique_lock<std::mutex> lock(fMutex);
+        fReady.wait(lock, [&]{ return !fQueue.empty() || fStop; });
+        if(fQueue.empty()) return;
+        block.swap(fQueue.front());
+        fQueue.pop_front();
+        fBusy = true;
+      }
+      fDone.notify_all();
+
+      const char *data = &block[0];
+      size_t size = block.size();
+      if(fLevel>0) {
+        Compress(block, packed);
+        data = packed.empty() ? 0 : &packed[0];
+        size = packed.size();
+      }
+      if(size>0 && fwrite(data, 1, size, fOut)!=size) {
+        if(!fFailed) std::cerr << "AsyncBlockBuf: write error, HepMC output is incomplete" << std::endl;
+        fFailed = true;
+      }
+      if(fIndex && size>0) {
+        fIndexBlock.size = size;
+        fIndexBlock.nEvents = CountHepMCEvents(&block[0], block.size());
+        HepMCIndex::WriteBlock(fIndex, fIndexBlock);
+        fflush(fIndex);
+        fIndexBlock.offset += size;
+        fIndexBlock.firstEvent += fIndexBlock.nEvents;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fBytesOut += size;
+        fBusy = false;
+      }
+      fDone.notify_all();
+    }
+  }
+
+  // one complete gzip member per block
+  void Compress(const std::vector<char> &in, std::vector<char> &out)
+  {
+    if(!GzipBlock(&in[0], in.size(), fLevel, out)) {
+      std::cerr << "AsyncBlockBuf: compression failed" << std::endl;
+      fFailed = true;
+    }
+  }
+
+  FILE *fOut;
+  int fLevel;
+  size_t fBlockSize;
+  size_t fMaxQueued;
+  std::vector<char> fBlock;
+  std::deque<std::vector<char> > fQueue;
+  std::mutex fMutex;
+  std::condition_variable fReady;
+  std::condition_variable fDone;
+  std::thread fThread;
+  bool fBusy;
+  bool fStop;
+  bool fFailed;
+  long long fBytesOut;
+  FILE *fIndex;
+  HepMCBlock fIndexBlock;
+};
+
+//------------------------------------------------------------------------------
+
+class HepMCOutput
+{
+public:
+  // resumeOffset >= 0: continue an existing file from that size
+  HepMCOutput(Pythia8::Pythia &pythia, long long resumeOffset = -1)
+    : fFile(0), fIndex(0), fBuf(0), fStream(0), fIO(0), fSavedCout(0), fOffset(0), fGood(true)
+  {
+    fMode = pythia.word("Main:hepmcOutput");
+    fName = pythia.word("Main:hepmcFile");
+    if(fMode=="none") return;
+    int level = 0;
+    if(fMode=="gzip") {
+      level = pythia.mode("Main:hepmcCompression");
+      if(fName!="-" && (fName.size()<3 || fName.compare(fName.size()-3,3,".gz")!=0)) fName += ".gz";
+    } else if(fMode!="ascii") {
+      std::cout << "unknown Main:hepmcOutput " << fMode << ", writing ascii" << std::endl;
+      fMode = "ascii";
+    }
+
+    if(fName=="-") {
+      // keep the event stream clean of the printout
+      fSavedCout = std::cout.rdbuf(std::cerr.rdbuf());
+      fFile = stdout;
+      if(resumeOffset>=0) std::cout << "HepMC output to stdout cannot be resumed, starting a new stream" << std::endl;
+      resumeOffset = -1;
+    } else if(resumeOffset>=0) {
+      fFile = fopen(fName.c_str(), "r+b");
+      if(!fFile || ftruncate(fileno(fFile), resumeOffset)!=0 || fseeko(fFile, 0, SEEK_END)!=0) {
+        std::cout << "cannot resume " << fName << " at " << resumeOffset << " bytes" << std::endl;
+        if(fFile) fclose(fFile);
+        fFile = 0;
+        fMode = "none";
+        fGood = false;
+        return;
+      }
+      fOffset = resumeOffset;
+    } else {
+      fFile = fopen(fName.c_str(), "wb");
+      if(!fFile) {
+        std::cout << "cannot open " << fName << ", no HepMC output" << std::endl;
+        fMode = "none";
+        return;
+      }
+    }
+    std::cout << "HepMC output (" << fMode << ") to " << (fName=="-" ? "stdout" : fName) << std::endl;
+    fBuf = new AsyncBlockBuf(fFile, level);
+    if(level>0 && fFile!=stdout) OpenIndex(resumeOffset);
+    fStream = new std::ostream(fBuf);
+    fIO = new HepMC::IO_GenEvent(*fStream);
+    // the file already has the header, which HepMC writes with the first
+    // event of a stream; the footer is still written at the end
+    if(resumeOffset>=0) HepMC::detail::get_stream_info(*fStream).set_finished_first_event(true);
+  }
+
+  ~HepMCOutput() { Close(); }
+
+  bool Enabled() const { return fIO!=0; }
+  HepMC::IO_GenEvent *IO() { return fIO; }
+  AsyncBlockBuf *Buf() { return fBuf; }
+  const std::string &FileName() const { return fName; }
+  // false if an existing file could not be resumed
+  bool Good() const { return fGood; }
+
+  // size of the file with everything written so far; this is where a
+  // resumed job continues. Waits for the writer thread.
+  long long Offset()
+  {
+    if(!fIO || fFile==stdout) return -1;
+    fStream->flush();
+    fBuf->Flush();
+    return fOffset+fBuf->BytesOut();
+  }
+
+  void Close()
+  {
+    if(!fIO) return;
+    // the footer is written when the IO_GenEvent goes away
+    delete fIO;
+    fIO = 0;
+    fStream->flush();
+    fBuf->Close();
+    delete fStream;
+    delete fBuf;
+    if(fFile!=stdout) fclose(fFile);
+    else fflush(stdout);
+    if(fIndex) fclose(fIndex);
+    if(fSavedCout) std::cout.rdbuf(fSavedCout);
+  }
+
+private:
+  // the index of the gzip blocks; a resumed file keeps the blocks before the checkpoint
+  void OpenIndex(long long resumeOffset)
+  {
+    std::string indexName = HepMCIndex::IndexName(fName);
+    HepMCIndex index;
+    if(resumeOffset>=0) {
+      if(!index.Read(fName)) {
+        std::cout << "no index " << indexName << " to resume, the file will not be indexed" << std::endl;
+        return;
+      }
+      index.Truncate(resumeOffset);
+      if(index.Size()!=resumeOffset) {
+        std::cout << indexName << " does not match the checkpoint, the file will not be indexed" << std::endl;
+        remove(indexName.c_str());
+        return;
+      }
+    }
+    fIndex = fopen(indexName.c_str(), "w");
+    if(!fIndex || !index.Write(fIndex)) {
+      std::cout << "cannot write " << indexName << ", the file will not be indexed" << std::endl;
+      if(fIndex) fclose(fIndex);
+      fIndex = 0;
+      return;
+    }
+    fBuf->SetIndex(fIndex, index.Size(), index.NEvents());
+  }
+
+  std::string fMode;
+  std::string fName;
+  FILE *fFile;
+  FILE *fIndex;
+  AsyncBlockBuf *fBuf;
+  std::ostream *fStream;
+  HepMC::IO_GenEvent *fIO;
+  std::streambuf *fSavedCout;
+  long long fOffset;
+  bool fGood;
+};
+
+#endif // HEPMCOUTPUT_H
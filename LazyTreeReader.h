@@ -0,0 +1,110 @@
+// LazyTreeReader.h
+// Reads the Delphes tree one branch at a time, and only the leaves the
+// analysis asks for. Unlike ExRootTreeReader::ReadEntry, which reads every
+// used branch for every entry, Load() only positions the chain, and a branch
+// is read by the first Get() of that entry. Events rejected on the jets and
+// leptons never deserialize the tracks or the gen particles.
+//
+//   LazyTreeReader reader(chain);
+//   int iJet = reader.Use("Jet", "PT Eta Phi BTag");
+//   reader.Load(entry);
+//   TClonesArray *jets = reader.Get(iJet);
+//
+// The leaves are names below the branch, with wildcards as in
+// TTree::SetBranchStatus ("Tau*" for the array leaves). A TRef to another
+// branch (Track.Particle) only resolves if the target branch has its
+// fUniqueID and fBits leaves and was read for the same entry.
+
+#ifndef LAZYTREEREADER_H
+#define LAZYTREEREADER_H
+
+#include "TChain.h"
+#include "TBranch.h"
+#include "TClonesArray.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+class LazyTreeReader
+{
+public:
+  LazyTreeReader(TChain *chain) : fChain(chain), fTreeNumber(-1), fLocalEntry(-1), fStamp(0)
+  {
+    fChain->SetBranchStatus("*", 0);
+  }
+
+  ~LazyTreeReader()
+  {
+    fChain->ResetBranchAddresses();
+    for(size_t ib=0;ib<fBranches.size();ib++) {
+      delete fBranches[ib]->array;
+      delete fBranches[ib];
+    }
+  }
+
+  // switches on the given leaves of a branch (space separated) and returns
+  // the index to Get() it with. Several users of the same branch get the
+  // same index, with the union of their leaves
+  int Use(const char *name, const char *leaves)
+  {
+    std::istringstream in(leaves);
+    std::string leaf;
+    while(in >> leaf) fChain->SetBranchStatus((std::string(name)+"."+leaf).c_str(), 1);
+    fChain->SetBranchStatus((std::string(name)+"_size").c_str(), 1);
+    for(size_t ib=0;ib<fBranches.size();ib++) {
+      if(fBranches[ib]->name==name) return ib;
+    }
+
+    Branch *b = new Branch;
+    b->name = name;
+    b->array = 0;  // allocated by ROOT with the class of the branch
+    b->branch = 0;
+    b->stamp = 0;
+    fBranches.push_back(b);
+    fChain->SetBranchAddress(name, &b->array);
+    return fBranches.size()-1;
+  }
+
+  Long64_t GetEntries() { return fChain->GetEntries(); }
+
+  // positions the chain on entry; nothing is read yet
+  bool Load(Long64_t entry)
+  {
+    fLocalEntry = fChain->LoadTree(entry);
+    if(fLocalEntry<0) return false;
+    if(fChain->GetTreeNumber()!=fTreeNumber) {
+      fTreeNumber = fChain->GetTreeNumber();
+      for(size_t ib=0;ib<fBranches.size();ib++) fBranches[ib]->branch = fChain->GetTree()->GetBranch(fBranches[ib]->name.c_str());
+    }
+    fStamp++;
+    return true;
+  }
+
+  // the branch for the loaded entry, read now if it was not yet
+  TClonesArray *Get(int ib)
+  {
+    Branch *b = fBranches[ib];
+    if(b->stamp!=fStamp) {
+      if(b->branch) b->branch->GetEntry(fLocalEntry);
+      b->stamp = fStamp;
+    }
+    return b->array;
+  }
+
+private:
+  struct Branch
+  {
+    std::string name;
+    TClonesArray *array;
+    TBranch *branch;
+    long stamp;  // fStamp of the entry last read
+  };
+
+  TChain *fChain;
+  int fTreeNumber;
+  Long64_t fLocalEntry;
+  long fStamp;
+  std::vector<Branch*> fBranches;
+};
+
+#endif // LAZYTREEREADER_H
@@ -0,0 +1,189 @@
+// PythiaDelphes.h
+// Runs the Delphes detector simulation inside the generator, following
+// examples/DelphesPythia8.cpp of Delphes: the modular Delphes pipeline is
+// built from the usual TCL card, and each pythia.event is copied straight
+// into the Delphes candidate arrays, so no HepMC file and no second
+// DelphesHepMC process are needed.
+//
+// Selected from the card with
+//   Main:delphesCard = delphes_card_CMS_imp.tcl
+//   Main:delphesFile = signal.root
+// Needs the executable to be built with Delphes (DELPHES set, see Makefile).
+
+#ifndef PYTHIADELPHES_H
+#define PYTHIADELPHES_H
+
+#include <iostream>
+#include <string>
+
+#include "Pythia8/Pythia.h"
+
+#ifdef WITH_DELPHES
+#include "TFile.h"
+#include "TObjArray.h"
+#include "TDatabasePDG.h"
+#include "TParticlePDG.h"
+#include "TMath.h"
+
+#include "modules/Delphes.h"
+#include "classes/DelphesClasses.h"
+#include "classes/DelphesFactory.h"
+
+#include "ExRootAnalysis/ExRootConfReader.h"
+#include "ExRootAnalysis/ExRootTreeWriter.h"
+#include "ExRootAnalysis/ExRootTreeBranch.h"
+#endif
+
+// the settings must be declared before the card is read
+inline void AddDelphesSettings(Pythia8::Settings &settings)
+{
+  settings.addWord("Main:delphesCard","");
+  settings.addWord("Main:delphesFile","delphes.root");
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef WITH_DELPHES
+
+class PythiaDelphes
+{
+public:
+  PythiaDelphes() : fFile(0), fTreeWriter(0), fConfReader(0), fDelphes(0) {}
+  ~PythiaDelphes() { Finish(); }
+
+  bool Init(const std::string &card, const std::string &fileName)
+  {
+    fFile = TFile::Open(fileName.c_str(), "RECREATE");
+    if(!fFile || fFile->IsZombie()) {
+      std::cout << "PythiaDelphes: cannot open " << fileName << std::endl;
+      return false;
+    }
+    fTreeWriter = new ExRootTreeWriter(fFile, "Delphes");
+    fBranchEvent = fTreeWriter->NewBranch("Event", HepMCEvent::Class());
+
+    fConfReader = new ExRootConfReader;
+    fConfReader->ReadFile(card.c_str());
+
+    fDelphes = new Delphes("Delphes");
+    fDelphes->SetConfReader(fConfReader);
+    fDelphes->SetTreeWriter(fTreeWriter);
+
+    fFactory = fDelphes->GetFactory();
+    fAllParticles = fDelphes->ExportArray("allParticles");
+    fStableParticles = fDelphes->ExportArray("stableParticles");
+    fPartons = fDelphes->ExportArray("partons");
+
+    fDelphes->InitTask();
+    std::cout << "Delphes (" << card << ") output to " << fileName << std::endl;
+    return true;
+  }
+
+  // simulate the detector for the current event of pythia and fill the tree
+  void ProcessEvent(Pythia8::Pythia &pythia, long long eventNumber)
+  {
+    fDelphes->Clear();
+    fTreeWriter->Clear();
+    ConvertInput(pythia, eventNumber);
+    fDelphes->ProcessTask();
+    fTreeWriter->Fill();
+  }
+
+  void Finish()
+  {
+    if(!fDelphes) return;
+    fDelphes->FinishTask();
+    fTreeWriter->Write();
+    delete fDelphes;
+    delete fConfReader;
+    delete fTreeWriter;
+    fFile->Close();
+    delete fFile;
+    fDelphes = 0;
+  }
+
+private:
+  // same as ConvertInput of DelphesPythia8.cpp; the Particle branch then
+  // follows the order of the Pythia record (without the system entry 0)
+  void ConvertInput(Pythia8::Pythia &pythia, long long eventNumber)
+  {
+    HepMCEvent *element = static_cast<HepMCEvent*>(fBranchEvent->NewEntry());
+    element->Number = eventNumber;
+    element->ProcessID = pythia.info.code();
+    element->MPI = 1;
+    element->Weight = pythia.info.weight();
+    element->Scale = pythia.info.QRen();
+    element->AlphaQED = pythia.info.alphaEM();
+    element->AlphaQCD = pythia.info.alphaS();
+    element->ID1 = pythia.info.id1();
+    element->ID2 = pythia.info.id2();
+    element->X1 = pythia.info.x1();
+    element->X2 = pythia.info.x2();
+    element->ScalePDF = pythia.info.QFac();
+    element->PDF1 = pythia.info.pdf1();
+    element->PDF2 = pythia.info.pdf2();
+    element->ReadTime = 0.;
+    element->ProcTime = 0.;
+
+    TDatabasePDG *pdg = TDatabasePDG::Instance();
+
+    for(int i = 1; i < pythia.event.size(); ++i) {
+      Pythia8::Particle &particle = pythia.event[i];
+
+      Candidate *candidate = fFactory->NewCandidate();
+      candidate->PID = particle.id();
+      int pdgCode = TMath::Abs(candidate->PID);
+      int status = particle.statusHepMC();
+      candidate->Status = status;
+
+      candidate->M1 = particle.mother1() - 1;
+      candidate->M2 = particle.mother2() - 1;
+      candidate->D1 = particle.daughter1() - 1;
+      candidate->D2 = particle.daughter2() - 1;
+
+      TParticlePDG *pdgParticle = pdg->GetParticle(candidate->PID);
+      candidate->Charge = pdgParticle ? int(pdgParticle->Charge()/3.0) : -999;
+      candidate->Mass = particle.m();
+
+      candidate->Momentum.SetPxPyPzE(particle.px(), particle.py(), particle.pz(), particle.e());
+      candidate->Position.SetXYZT(particle.xProd(), particle.yProd(), particle.zProd(), particle.tProd());
+
+      fAllParticles->Add(candidate);
+
+      if(!pdgParticle) continue;
+
+      if(status == 1) {
+        fStableParticles->Add(candidate);
+      } else if(pdgCode <= 5 || pdgCode == 21 || pdgCode == 15) {
+        fPartons->Add(candidate);
+      }
+    }
+  }
+
+  TFile *fFile;
+  ExRootTreeWriter *fTreeWriter;
+  ExRootTreeBranch *fBranchEvent;
+  ExRootConfReader *fConfReader;
+  Delphes *fDelphes;
+  DelphesFactory *fFactory;
+  TObjArray *fAllParticles;
+  TObjArray *fStableParticles;
+  TObjArray *fPartons;
+};
+
+#else
+
+class PythiaDelphes
+{
+public:
+  bool Init(const std::string &, const std::string &)
+  {
+    std::cout << "PythiaDelphes: built without Delphes, rebuild with DELPHES set" << std::endl;
+    return false;
+  }
+  void ProcessEvent(Pythia8::Pythia &, long long) {}
+  void Finish() {}
+};
+
+#endif // WITH_DELPHES
+
+#endif // PYTHIADELPHES_H
@@ -0,0 +1,50 @@
+// ScanAxis.h
+// The axes of the cut scans (emgD -scan, tuneTCBTScan), given as
+//   NAME=lo:hi:n      n values from lo to hi
+//   NAME=v1,v2,...    the values listed
+
+#ifndef SCANAXIS_H
+#define SCANAXIS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// the index of NAME in names and its values, -1 for a malformed spec or an unknown name
+inline int ParseScanAxis(const std::string &spec, const char *const *names, int nnames, std::vector<float> &values)
+{
+  values.clear();
+  size_t eq = spec.find('=');
+  if(eq==std::string::npos) return -1;
+  int axis = -1;
+  for(int a=0;a<nnames;a++) {
+    if(spec.compare(0, eq, names[a])==0) axis = a;
+  }
+  if(axis<0) return -1;
+
+  std::string list = spec.substr(eq+1);
+  float lo, hi;
+  int n;
+  char rest;
+  if(sscanf(list.c_str(), "%f:%f:%d%c", &lo, &hi, &n, &rest)==3) {
+    if(n<1) return -1;
+    for(int i=0;i<n;i++) values.push_back(n==1 ? lo : lo+(hi-lo)*i/(n-1));
+  } else {
+    std::istringstream in(list);
+    std::string item;
+    while(std::getline(in, item, ',')) {
+      char *end;
+      float x = strtof(item.c_str(), &end);
+      if(end==item.c_str() || *end!='\0') {
+        values.clear();
+        return -1;
+      }
+      values.push_back(x);
+    }
+  }
+  return values.empty() ? -1 : axis;
+}
+
+#endif // SCANAXIS_H
@@ -0,0 +1,142 @@
+// StageTimer.h
+// Per-stage timers for the event loop. Each thread has its own StageTimer
+// (no locking); they are merged at the end and written as a JSON summary:
+// per stage the number of calls, total and mean time, events/s, and the
+// per-call latency histogram (8 log bins per decade from 100 ns to 100 s),
+// plus the wall time and the peak RSS of the job.
+//
+// Switched on at run time (Main:timing in pythiaTree); when off, Start()
+// and Stop() only test a flag. Building with -DNO_STAGE_TIMERS removes
+// the timers completely.
+
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+class StageTimer
+{
+public:
+  static const int kBinsPerDecade = 8;
+  static const int kNBins = 9*kBinsPerDecade;  // 1e-7 s .. 1e2 s
+
+  StageTimer(const char *const *names, int nStages, bool on)
+    : fOn(on), fNames(names, names+nStages), fStart(nStages),
+      fCalls(nStages, 0), fTotal(nStages, 0.), fHist(nStages, std::vector<long>(kNBins+2, 0)) {}
+
+  bool On() const { return fOn; }
+
+#ifdef NO_STAGE_TIMERS
+  void Start(int) {}
+  void Stop(int) {}
+#else
+  void Start(int stage)
+  {
+    if(!fOn) return;
+    fStart[stage] = Clock::now();
+  }
+
+  void Stop(int stage)
+  {
+    if(!fOn) return;
+    double dt = std::chrono::duration<double>(Clock::now()-fStart[stage]).count();
+    fCalls[stage]++;
+    fTotal[stage] += dt;
+    fHist[stage][Bin(dt)]++;
+  }
+#endif
+
+  // times the enclosing block
+  class Scope
+  {
+  public:
+    Scope(StageTimer &timer, int stage) : fTimer(timer), fStage(stage) { fTimer.Start(fStage); }
+    ~Scope() { fTimer.Stop(fStage); }
+  private:
+    StageTimer &fTimer;
+    int fStage;
+  };
+
+  void Add(const StageTimer &other)
+  {
+    for(size_t s=0;s<fNames.size();s++) {
+      fCalls[s] += other.fCalls[s];
+      fTotal[s] += other.fTotal[s];
+      for(int b=0;b<kNBins+2;b++) fHist[s][b] += other.fHist[s][b];
+    }
+  }
+
+  void Print(std::ostream &os) const
+  {
+    os << " stage              calls     total (s)   mean (ms)" << std::endl;
+    for(size_t s=0;s<fNames.size();s++) {
+      char line[128];
+      snprintf(line, sizeof(line), " %-14s %9ld %13.3f %11.4f", fNames[s].c_str(), fCalls[s], fTotal[s],
+               fCalls[s]>0 ? 1e3*fTotal[s]/fCalls[s] : 0.);
+      os << line << std::endl;
+    }
+  }
+
+  // peak resident set size of the process in kB
+  static long PeakRSS()
+  {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)!=0) return -1;
+    return usage.ru_maxrss;
+  }
+
+  // events/s per stage are per thread; the total is nEvents over the wall time
+  bool WriteJSON(const std::string &fileName, double wallTime, long nEvents, int nThreads) const
+  {
+    std::ofstream out(fileName.c_str());
+    if(!out) return false;
+    out.precision(6);
+    out << "{\n";
+    out << "  \"wall_time_s\": " << wallTime << ",\n";
+    out << "  \"events\": " << nEvents << ",\n";
+    out << "  \"threads\": " << nThreads << ",\n";
+    out << "  \"events_per_s\": " << (wallTime>0 ? nEvents/wallTime : 0.) << ",\n";
+    out << "  \"peak_rss_kb\": " << PeakRSS() << ",\n";
+    out << "  \"latency_bins\": { \"min_s\": 1e-7, \"bins_per_decade\": " << kBinsPerDecade
+        << ", \"nbins\": " << kNBins << ", \"underflow_first\": true, \"overflow_last\": true },\n";
+    out << "  \"stages\": [\n";
+    for(size_t s=0;s<fNames.size();s++) {
+      out << "    { \"name\": \"" << fNames[s] << "\""
+          << ", \"calls\": " << fCalls[s]
+          << ", \"total_s\": " << fTotal[s]
+          << ", \"mean_s\": " << (fCalls[s]>0 ? fTotal[s]/fCalls[s] : 0.)
+          << ", \"calls_per_s\": " << (fTotal[s]>0 ? fCalls[s]/fTotal[s] : 0.)
+          << ", \"latency\": [";
+      for(int b=0;b<kNBins+2;b++) out << (b ? "," : "") << fHist[s][b];
+      out << "] }" << (s+1<fNames.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return true;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  static int Bin(double dt)
+  {
+    if(dt<1e-7) return 0;
+    int b = 1+int(std::floor((std::log10(dt)+7.)*kBinsPerDecade));
+    return b>kNBins ? kNBins+1 : b;
+  }
+
+  bool fOn;
+  std::vector<std::string> fNames;
+  std::vector<Clock::time_point> fStart;
+  std::vector<long> fCalls;
+  std::vector<double> fTotal;
+  std::vector<std::vector<long> > fHist;
+};
+
+#endif // STAGETIMER_H
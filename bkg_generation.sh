@@ -12,6 +12,9 @@ usage() {
 	$ECHO "-d            \tdirectory of premade cards (default = $PWD/mg5cards)"
 	$ECHO "-p            \tprocess name (default = ttbar)"
 	$ECHO "-c            \tcustom card name (default = process name)"
+	$ECHO "-f            \twrite the HepMC events to this fifo (must end in .hepmc.fifo)"
+	$ECHO "-k            \tcache of process directories (default = $MGCACHE)"
+	$ECHO "-n            \tdo not use the cache, always run mg5_aMC"
 	$ECHO "-h            \tdisplay this message and exit"
 	exit $1
 }
@@ -19,16 +22,25 @@ usage() {
 CARDSDIR=$PWD/mg5cards
 PROCNAME=ttbar
 CUSTOMCARD=""
+HEPMCFIFO=""
+# next to the script, so that jobs in other directories share it
+MGCACHE=$(dirname $(readlink -f $0))/mg5cache
 
 # check arguments
-while getopts "d:p:c:h" opt; do
+while getopts "d:p:c:f:k:nh" opt; do
 	case "$opt" in
-	d) CARDSDIR=$OPTARG
+	d) CARDSDIR=$(readlink -f $OPTARG)
 	;;
 	p) PROCNAME=$OPTARG
 	;;
 	c) CUSTOMCARD=$OPTARG
 	;;
+	f) HEPMCFIFO=$OPTARG
+	;;
+	k) MGCACHE=$(readlink -f $OPTARG)
+	;;
+	n) MGCACHE=""
+	;;
 	h) usage 0
 	;;
 	esac
@@ -52,7 +64,34 @@ if [ -d ${CUSTOMCARD} ]; then
 fi
 
 # Run the code-generation step to create the process directory
-mg5_aMC ${CARDSDIR}/${PROCNAME}_proc_card.dat
+if [ -z "$MGCACHE" ]; then
+	mg5_aMC ${CARDSDIR}/${PROCNAME}_proc_card.dat
+else
+	# the process directories are cached by the hash of the proc card and the MadGraph version
+	MGVERSION=$(cat ${MADGRAPH}/VERSION 2> /dev/null || readlink -f $(which mg5_aMC))
+	MGKEY=$( (cat ${CARDSDIR}/${PROCNAME}_proc_card.dat; echo "$MGVERSION") | sha1sum | cut -c1-16)
+	CACHEDIR=${MGCACHE}/${PROCNAME}_${MGKEY}
+	mkdir -p ${MGCACHE}
+	# one job generates, the others wait for it
+	(
+		flock 9
+		if [ ! -d ${CACHEDIR} ]; then
+			$ECHO "Generating ${PROCNAME} into the cache ${CACHEDIR}"
+			GENDIR=$(mktemp -d ${CACHEDIR}.XXXXXX)
+			(cd ${GENDIR} && mg5_aMC ${CARDSDIR}/${PROCNAME}_proc_card.dat)
+			if [ ! -d ${GENDIR}/${PROCNAME} ]; then
+				$ECHO "mg5_aMC did not create ${PROCNAME}, check the output line of the proc card"
+				rm -rf ${GENDIR}
+				exit 1
+			fi
+			cp ${CARDSDIR}/${PROCNAME}_proc_card.dat ${GENDIR}/
+			mv ${GENDIR} ${CACHEDIR}
+		fi
+	) 9> ${CACHEDIR}.lock
+	$ECHO "Using the cached process directory ${CACHEDIR}"
+	# a copy, not hard links: MadGraph rewrites the cards and compiles in place
+	cp -a --reflink=auto ${CACHEDIR}/${PROCNAME} ./
+fi
 
 # move generic process directory to specific custom directory for this job
 if [ "$PROCNAME" != "$CUSTOMCARD" ]; then
@@ -84,6 +123,11 @@ for ((i=0; i < ${#ORIGCARDS[@]}; i++)); do
 	fi
 done
 
+# stream the showered events into a fifo (created by MadGraph) instead of the hepmc.gz file
+if [ -n "$HEPMCFIFO" ]; then
+	sed -i 's|^HEPMCoutput:file .*|HEPMCoutput:file = fifo@'${HEPMCFIFO}'|' ./Cards/pythia8_card.dat
+fi
+
 # Generate events
 
 echo "done" > makegrid.dat
@@ -0,0 +1,231 @@
+#!/bin/bash -e
+
+# Sharded background production: the events are split in shards, each a
+# bkg_generation.sh run with its own number of events and seed, followed by
+# Delphes. The shards run in parallel on the local cores or as a condor job
+# array. The manifest shards_[custom]/manifest.txt lists the shard, seed and
+# number of events of every shard ever planned, so running again with -n
+# and -s adds shards with new seeds.
+
+case `uname` in
+	Linux) ECHO="echo -e" ;;
+	*) ECHO="echo" ;;
+esac
+
+usage() {
+	$ECHO "bkg_shards.sh [options]"
+	$ECHO
+	$ECHO "Options:"
+	$ECHO "-d            \tdirectory of premade cards (default = $PWD/mg5cards)"
+	$ECHO "-p            \tprocess name (default = ttbar)"
+	$ECHO "-c            \tcustom card name (default = process name)"
+	$ECHO "-n            \ttotal number of events to add"
+	$ECHO "-s            \tnumber of shards to add (default = 1)"
+	$ECHO "-e            \tseed of the first new shard (default = 1 + largest seed in the manifest)"
+	$ECHO "-j            \tshards run at the same time locally (default = number of cores)"
+	$ECHO "-b            \twrite a condor job array for the new shards instead of running them"
+	$ECHO "-D            \tDelphes card (default = delphes_card_CMS_imp.tcl)"
+	$ECHO "-l            \tlist the shards and their status and exit"
+	$ECHO "-r            \trerun the shards that are not done and exit"
+	$ECHO "-h            \tdisplay this message and exit"
+	exit $1
+}
+
+SCRIPTDIR=$(dirname $(readlink -f $0))
+CARDSDIR=$PWD/mg5cards
+PROCNAME=ttbar
+CUSTOMCARD=""
+NEVENTS=""
+NSHARDS=1
+FIRSTSEED=""
+NJOBS=$(nproc)
+BATCH=""
+DELPHESCARD=$PWD/delphes_card_CMS_imp.tcl
+LIST=""
+RERUN=""
+SHARD=""
+
+# check arguments (-x shard runs a single shard, for the local jobs and condor)
+while getopts "d:p:c:n:s:e:j:bD:lrx:h" opt; do
+	case "$opt" in
+	d) CARDSDIR=$(readlink -f $OPTARG)
+	;;
+	p) PROCNAME=$OPTARG
+	;;
+	c) CUSTOMCARD=$OPTARG
+	;;
+	n) NEVENTS=$OPTARG
+	;;
+	s) NSHARDS=$OPTARG
+	;;
+	e) FIRSTSEED=$OPTARG
+	;;
+	j) NJOBS=$OPTARG
+	;;
+	b) BATCH=yes
+	;;
+	D) DELPHESCARD=$(readlink -f $OPTARG)
+	;;
+	l) LIST=yes
+	;;
+	r) RERUN=yes
+	;;
+	x) SHARD=$OPTARG
+	;;
+	h) usage 0
+	;;
+	esac
+done
+
+if [ -z "$CUSTOMCARD" ]; then
+	CUSTOMCARD=$PROCNAME
+fi
+
+SHARDDIR=$PWD/shards_${CUSTOMCARD}
+MANIFEST=$SHARDDIR/manifest.txt
+
+status() {
+	if [ -e $SHARDDIR/shard_$1/DONE ]; then
+		echo done
+	elif [ -e $SHARDDIR/shard_$1/FAILED ]; then
+		echo failed
+	elif [ -d $SHARDDIR/shard_$1 ]; then
+		echo started
+	else
+		echo planned
+	fi
+}
+
+# one shard: cards with its own number of events and seed, MadGraph + Pythia, Delphes
+run_shard() {
+	local SHARD=$1
+	local LINE=($(grep "^$SHARD " $MANIFEST))
+	if [ ${#LINE[@]} -lt 3 ]; then
+		$ECHO "shard $SHARD is not in $MANIFEST"
+		exit 1
+	fi
+	local SEED=${LINE[1]}
+	local NEV=${LINE[2]}
+	local WORK=$SHARDDIR/shard_$SHARD
+	local CARDS=$WORK/cards
+	local SHARDCARD=${CUSTOMCARD}_shard${SHARD}
+	rm -rf $WORK
+	mkdir -p $CARDS
+
+	# the premade cards, plus the customization of this shard after that of the sample
+	for CARD in ${CARDSDIR}/${PROCNAME}_*.dat ${CARDSDIR}/pythia8_card.dat; do
+		if [ -e $CARD ]; then ln -s $CARD $CARDS/; fi
+	done
+	if [ -e ${CARDSDIR}/${CUSTOMCARD}_customizecards.dat ]; then
+		cat ${CARDSDIR}/${CUSTOMCARD}_customizecards.dat > $CARDS/${SHARDCARD}_customizecards.dat
+		echo "" >> $CARDS/${SHARDCARD}_customizecards.dat
+	fi
+	echo "set run_card nevents $NEV" >> $CARDS/${SHARDCARD}_customizecards.dat
+	echo "set run_card iseed $SEED" >> $CARDS/${SHARDCARD}_customizecards.dat
+
+	cd $WORK
+	if $SCRIPTDIR/bkg_generation.sh -p $PROCNAME -c $SHARDCARD -d $CARDS > generation.log 2>&1 && \
+	   gunzip -c ${SHARDCARD}/Events/pilotrun/tag_1_pythia8_events.hepmc.gz | DelphesHepMC $DELPHESCARD $SHARDDIR/${SHARDCARD}.root > delphes.log 2>&1; then
+		echo "$SHARDDIR/${SHARDCARD}.root" > DONE
+		$ECHO "shard $SHARD done"
+	else
+		touch FAILED
+		$ECHO "shard $SHARD failed, see $WORK"
+		exit 1
+	fi
+}
+
+if [ -n "$SHARD" ]; then
+	if [ -z "$DELPHES" ]; then
+		cd $SCRIPTDIR
+		source init.sh
+		cd - > /dev/null
+	fi
+	run_shard $SHARD
+	exit 0
+fi
+
+if [ -n "$LIST" ]; then
+	if [ ! -e $MANIFEST ]; then
+		$ECHO "no shards in $SHARDDIR"
+		exit 0
+	fi
+	TOTAL=0
+	while read SHARD SEED NEV; do
+		if [ "$SHARD" = "#" ]; then continue; fi
+		$ECHO "$SHARD\t$SEED\t$NEV\t$(status $SHARD)"
+		if [ "$(status $SHARD)" = done ]; then TOTAL=$((TOTAL+NEV)); fi
+	done < $MANIFEST
+	$ECHO "events done: $TOTAL"
+	exit 0
+fi
+
+# the shards to run: the new ones, or those not done
+NEWSHARDS=()
+mkdir -p $SHARDDIR
+if [ ! -e $MANIFEST ]; then
+	echo "# shard seed nevents" > $MANIFEST
+fi
+if [ -n "$RERUN" ]; then
+	while read SHARD SEED NEV; do
+		if [ "$SHARD" = "#" ]; then continue; fi
+		if [ "$(status $SHARD)" != done ]; then NEWSHARDS+=($SHARD); fi
+	done < $MANIFEST
+else
+	if [ -z "$NEVENTS" ] || [ $NSHARDS -lt 1 ]; then
+		usage 1
+	fi
+	# new shards continue the numbering and the seeds of the manifest
+	FIRSTSHARD=$(awk '!/^#/ { if($1+1>n) n=$1+1 } END { print n+0 }' $MANIFEST)
+	if [ -z "$FIRSTSEED" ]; then
+		FIRSTSEED=$(awk '!/^#/ { if($2+1>n) n=$2+1 } END { print (n>0 ? n : 1) }' $MANIFEST)
+	fi
+	USED=$(awk -v lo=$FIRSTSEED -v hi=$((FIRSTSEED+NSHARDS-1)) '!/^#/ && $2>=lo && $2<=hi' $MANIFEST)
+	if [ -n "$USED" ]; then
+		$ECHO "seeds $FIRSTSEED to $((FIRSTSEED+NSHARDS-1)) are already used by:\n$USED"
+		exit 1
+	fi
+	for ((i=0; i < NSHARDS; i++)); do
+		SHARD=$((FIRSTSHARD+i))
+		# the remainder goes to the first shards
+		NEV=$((NEVENTS/NSHARDS + (i < NEVENTS%NSHARDS ? 1 : 0)))
+		echo "$SHARD $((FIRSTSEED+i)) $NEV" >> $MANIFEST
+		NEWSHARDS+=($SHARD)
+	done
+fi
+
+if [ ${#NEWSHARDS[@]} -eq 0 ]; then
+	$ECHO "nothing to run"
+	exit 0
+fi
+
+SHARDARGS="-p $PROCNAME -c $CUSTOMCARD -d $CARDSDIR -D $DELPHESCARD"
+if [ -n "$BATCH" ]; then
+	# one job per shard, the shard number from the list. The jobs work in the
+	# shard directory and read the scripts and cards on the shared filesystem,
+	# so nothing is transferred (the script finds the others next to itself) and
+	# they start in the directory of the manifest
+	JDL=$SHARDDIR/shards_$(date +%s).jdl
+	printf "%s\n" "${NEWSHARDS[@]}" > ${JDL%.jdl}.list
+	cat > $JDL <<EOF
+universe = vanilla
+Executable = $SCRIPTDIR/bkg_shards.sh
+Arguments = $SHARDARGS -x \$(shard)
+initialdir = $PWD
+should_transfer_files = NO
+transfer_executable = False
+Requirements = TARGET.FileSystemDomain == "privnet" && machine != "r510-0-1.privnet"
+Output = $SHARDDIR/shard_\$(shard).stdout
+Error = $SHARDDIR/shard_\$(shard).stderr
+Log = $SHARDDIR/shard_\$(cluster)_\$(process).condor
+Queue shard from ${JDL%.jdl}.list
+EOF
+	$ECHO "submit with: condor_submit $JDL"
+else
+	printf "%s\n" "${NEWSHARDS[@]}" | xargs -P $NJOBS -I{} $SCRIPTDIR/bkg_shards.sh $SHARDARGS -x {} || $ECHO "some shards failed, rerun them with -r"
+fi
+
+$ECHO "manifest: $MANIFEST"
+$ECHO "End of job"
+
+exit 0
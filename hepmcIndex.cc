@@ -0,0 +1,154 @@
+// hepmcIndex.cc
+// Block-compressed, indexed HepMC files (see HepMCIndex.h).
+//
+//   hepmcIndex.exe build in.hepmc[.gz] out.hepmc.gz [threads [block MB]]
+//     rewrites a HepMC file (plain or gzip, e.g. the tag_1_pythia8_events.hepmc.gz
+//     of MadGraph) as gzip members of whole events, compressed in parallel,
+//     and writes the index out.hepmc.gz.idx
+//   hepmcIndex.exe extract file.hepmc.gz first last
+//     writes the events [first, last) to stdout, as a complete HepMC stream
+//   hepmcIndex.exe info file.hepmc.gz
+//     prints the number of events and blocks
+//
+// The gzip output of pythiaTree is already indexed.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "HepMCIndex.h"
+
+using namespace std;
+
+void Usage(const char *name)
+{
+  cout << "usage: " << name << " build in.hepmc[.gz] out.hepmc.gz [threads [block MB]]" << endl;
+  cout << "       " << name << " extract file.hepmc.gz first last" << endl;
+  cout << "       " << name << " info file.hepmc.gz" << endl;
+}
+
+
+// compresses the blocks in parallel, then writes them and their index in order
+bool WriteBlocks(vector<string> &blocks, FILE *out, FILE *indexFile, HepMCBlock &next)
+{
+  vector<vector<char> > packed(blocks.size());
+  vector<char> ok(blocks.size(), 0);
+  vector<thread> threads;
+  for(size_t ib=0;ib<blocks.size();ib++) {
+    threads.push_back(thread([&, ib]() { ok[ib] = GzipBlock(blocks[ib].data(), blocks[ib].size(), 6, packed[ib]); }));
+  }
+  for(size_t ib=0;ib<threads.size();ib++) threads[ib].join();
+  for(size_t ib=0;ib<blocks.size();ib++) {
+    if(!ok[ib] || fwrite(&packed[ib][0], 1, packed[ib].size(), out)!=packed[ib].size()) return false;
+    next.size = packed[ib].size();
+    next.nEvents = CountHepMCEvents(blocks[ib].data(), blocks[ib].size());
+    HepMCIndex::WriteBlock(indexFile, next);
+    next.offset += next.size;
+    next.firstEvent += next.nEvents;
+  }
+  blocks.clear();
+  return true;
+}
+
+
+int Build(const string &inName, const string &outName, int nThreads, size_t blockSize)
+{
+  gzFile in = gzopen(inName.c_str(), "rb");
+  if(!in) {
+    cout << "cannot open " << inName << endl;
+    return 1;
+  }
+  FILE *out = fopen(outName.c_str(), "wb");
+  FILE *indexFile = fopen(HepMCIndex::IndexName(outName).c_str(), "w");
+  if(!out || !indexFile) {
+    cout << "cannot write " << outName << endl;
+    return 1;
+  }
+  gzbuffer(in, 1<<20);
+
+  // a block ends before the first event starting after blockSize bytes
+  HepMCBlock next = {0, 0, 0, 0};
+  vector<string> blocks;
+  string block;
+  block.reserve(blockSize+(1<<20));
+  vector<char> line(1<<16);
+  bool lineStart = true;
+  bool ok = true;
+  while(ok && gzgets(in, &line[0], line.size())) {
+    size_t n = strlen(&line[0]);
+    if(lineStart && n>1 && line[0]=='E' && line[1]==' ' && block.size()>=blockSize) {
+      blocks.push_back(string());
+      blocks.back().swap(block);
+      block.reserve(blockSize+(1<<20));
+      if((int) blocks.size()==nThreads) ok = WriteBlocks(blocks, out, indexFile, next);
+    }
+    block.append(&line[0], n);
+    // lines longer than the buffer come in pieces
+    lineStart = n>0 && line[n-1]=='\n';
+  }
+  int err;
+  gzerror(in, &err);
+  if(err!=Z_OK && err!=Z_STREAM_END) {
+    cout << "error reading " << inName << endl;
+    ok = false;
+  }
+  gzclose(in);
+  if(!block.empty()) blocks.push_back(block);
+  if(ok) ok = WriteBlocks(blocks, out, indexFile, next);
+  if(fclose(out)!=0 || fclose(indexFile)!=0) ok = false;
+  if(!ok) {
+    cout << "cannot write " << outName << endl;
+    return 1;
+  }
+  cout << outName << ": " << next.firstEvent << " events in " << next.offset << " bytes" << endl;
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if(argc<3) {
+    Usage(argv[0]);
+    return 1;
+  }
+  string mode = argv[1];
+  string fileName = argv[2];
+
+  if(mode=="build") {
+    if(argc<4) {
+      Usage(argv[0]);
+      return 1;
+    }
+    int nThreads = argc>4 ? atoi(argv[4]) : 0;
+    if(nThreads<=0) nThreads = max(1u, thread::hardware_concurrency());
+    size_t blockSize = argc>5 ? atof(argv[5])*(1<<20) : 4<<20;
+    return Build(fileName, argv[3], nThreads, blockSize);
+  }
+
+  HepMCIndex index;
+  if(!index.Read(fileName)) {
+    // not to stdout, which may be the input of Delphes
+    cerr << "cannot read the index " << HepMCIndex::IndexName(fileName)
+         << " (hepmcIndex.exe build to make an indexed copy)" << endl;
+    return 1;
+  }
+  if(mode=="info") {
+    cout << fileName << ": " << index.NEvents() << " events in " << index.Blocks().size() << " blocks" << endl;
+    return 0;
+  }
+  if(mode=="extract" && argc>4) {
+    if(!index.Extract(fileName, atoll(argv[3]), atoll(argv[4]), stdout)) {
+      cerr << "cannot read " << fileName << endl;
+      return 1;
+    }
+    return 0;
+  }
+  Usage(argv[0]);
+  return 1;
+}
@@ -22,6 +22,7 @@ using namespace std;
 // Header file to access Pythia 8 program elements.
 #include "Pythia8/Pythia.h"
 #include "Pythia8Plugins/HepMC2.h"
+#include "HepMCOutput.h"
 
 // ROOT, for histogramming.
 #include "TH1.h"
@@ -54,7 +55,11 @@ int main(int argc, char* argv[]) {
   // Create Pythia instance and set it up to generate hard QCD processes
   // above pTHat = 20 GeV for pp collisions at 14 TeV.
   Pythia pythia;
+  AddHepMCOutputSettings(pythia.settings);
   pythia.readFile("junk.cmnd");
+  // open the HepMC output first, it may take over stdout
+  HepMCOutput hepmcOut(pythia);
+  if(!hepmcOut.Enabled()) ihepMCout = 0;
   pythia.init();
   int nEvent = pythia.mode("Main:numberOfEvents");
 
@@ -63,7 +68,7 @@ int main(int argc, char* argv[]) {
   // create a file for hepMC output if needed                                   
   //ihepMCout                                                                   
   HepMC::Pythia8ToHepMC ToHepMC;
-  HepMC::IO_GenEvent ascii_io("hepmc.out", std::ios::out);
+  HepMC::IO_GenEvent *ascii_io = hepmcOut.IO();
 
   // Begin event loop. Generate event; skip if generation aborted.
 
@@ -88,7 +93,7 @@ int main(int argc, char* argv[]) {
 
       // Write the HepMC event to file. Done with it.                          \
       //                                                         
-      ascii_io << hepmcevt;
+      (*ascii_io) << hepmcevt;
       delete hepmcevt;
 
     }
@@ -96,6 +101,7 @@ int main(int argc, char* argv[]) {
 
 
   }  // end loop over events
+  hepmcOut.Close();
 
 
 
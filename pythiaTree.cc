@@ -15,13 +15,28 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <ctime>
 #include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <sstream>
+#include <cstdio>
+#include <chrono>
 
 using namespace std;
 
 // Header file to access Pythia 8 program elements.
 #include "Pythia8/Pythia.h"
 #include "Pythia8Plugins/HepMC2.h"
+#include "HepMCOutput.h"
+#include "PythiaDelphes.h"
+#include "EventGraph.h"
+#include "AntiKtJets.h"
+#include "DeltaRMatch.h"
+#include "StageTimer.h"
 
 // ROOT, for histogramming.
 #include "TH1.h"
@@ -35,6 +50,14 @@ using namespace std;
 // ROOT, for saving file.
 #include "TFile.h"
 
+// ROOT, for running histogram filling in several threads.
+#include "TROOT.h"
+
+// ROOT, for the checkpoints.
+#include "TList.h"
+#include "TNamed.h"
+#include "TDirectory.h"
+
 
 
 using namespace Pythia8;
@@ -44,42 +67,6 @@ int idsp=0;
 int idbg=0;
 int ihepMCout=1; 
 
-int nCharged, nNeutral, nTot;
-
-int main(int argc, char* argv[]) {
-
-  Pythia pythia;
-  // Read in commands from external file.
-  string filename = "modelA_res.cmnd";
-  if(argc>1) filename = argv[1];
-  cout << "pythia.readFile(" << filename << ");" << endl;
-  pythia.readFile(filename);
-  pythia.init();
-  int nEvent = pythia.mode("Main:numberOfEvents");
-
-  // Create the ROOT application environment.
-  TApplication theApp("hist", &argc, argv);
-
-  // Create file on which histogram(s) can be saved.
-  TFile* outFile = new TFile("PythiaOutput.root", "RECREATE");
-
-
-  // create a file for the event display
-  ofstream outPut;
-  if(idsp>0) outPut.open("forDisplay.txt");
-  if(idsp>0) outPut<<" pid x0 y0 z0 px py pz"<<endl;
-
-
-  // create a file for hepMC output if needed
-  //ihepMCout
-    HepMC::Pythia8ToHepMC ToHepMC;
-    HepMC::IO_GenEvent ascii_io("hepmc.out", std::ios::out);
-
-
-
-
-unordered_map<int,std::string> pdgName;
-unordered_map<int,int> pdgNum;
 
 
 const int npart=12;
@@ -98,117 +85,623 @@ const char *partNames[npart] = {
     "unknown"
 };
 
- pdgNum.emplace(11,0);
- pdgNum.emplace(12,1);
- pdgNum.emplace(13,2);
- pdgNum.emplace(14,3);
-pdgNum.emplace(211,4);
-pdgNum.emplace(321,5);
-pdgNum.emplace(1114,6);
-pdgNum.emplace(2112,7);
-pdgNum.emplace(2212,8);
- pdgNum.emplace(22,9);
- pdgNum.emplace(130,10);
+
+// pdg id -> index in partNames, as a flat table so the event loop does not
+// hash. Ids missing from the map (negative ids, ids beyond the table) give
+// 0, which is what operator[] of the map returned for them
+class PdgIndex
+{
+public:
+  PdgIndex(const unordered_map<int,int> &pdgMap) {
+    int maxId = 0;
+    for(auto &p : pdgMap) if(p.first>maxId) maxId = p.first;
+    table.assign(maxId+1, 0);
+    for(auto &p : pdgMap) if(p.first>=0) table[p.first] = p.second;
+  }
+  int operator[](int id) const { return (id>=0 && id<(int)table.size()) ? table[id] : 0; }
+private:
+  vector<int> table;
+};
 
 
-for(int hh=0;hh<1000;hh++) {
-  auto got2 = pdgNum.find(hh);
-  if(got2 == pdgNum.end()) pdgNum.emplace(hh,npart-1);
- }
+// buffers of the event analysis, kept by each worker from event to event
+// so that the steady-state event loop does not allocate
+struct EventBuffers
+{
+  vector<int> ptstdau;
+  vector<int> ndqinjet;
+  EtaPhiPoints jetPts, dpiPts, dqPts;
+};
+
+
+// all the histograms filled in the event loop.  In the parallel mode each
+// worker fills its own set and the sets are merged at the end of the run
+struct HVPlots
+{
+  TH1F *hmultch;
+  TH1F *hmultneu;
+  TH1F *hppid;
+  TH1F *hppidHV;
+  TH1F *hppid2HV;
+  TH1F *hppid2ddg;
+  TH2F *hmassHV;
+  TH2F *hqHV;
+  TH1F *hmHV;
+  TH1F *hm2HV;
+  TH1F *hd0HV;
+  TH1F *hd0gHV;
+  TH1F *ht0HV;
+  TH1F *hd0dHV;
+  TH2F *hd0d2HV;
+  TH1F *hstatus;
+  TH1F *hstatus2;
+  TH1F *hndau;
+  TH1F *hnsdau;
+  TH1F *hd0HVs1;
+  TH2F *hndau2;
+  TH1F *hndpis;
+  TH1F *hnjet;
+  TH1F *hjetpT;
+  TH1F *hjet1pT;
+  TH1F *hjet2pT;
+  TH1F *hjet3pT;
+  TH1F *hjet4pT;
+  TH1F *hjety;
+  TH1F *hjetphi;
+  TH1F *hndqs;
+  TH1F *hndq71;
+  TH1F *hndqnm;
+  TH1F *hdRdqj;
+  TH1F *hdRdj;
+  TH1F *htright;
+  TH1F *hcutflow;
+  TH1F *hdRdpisdjet;
+  TH1F *hnjetdpi;
+  TH1F *hndpipj;
+  TH1F *hptjetdp;
+  TH1F *hndpipjndq;
+  TH1F *hndpipjdq;
+  TH1F *hndpipjd;
+  TH1F *hdppt;
+  TH1F *hptjetdpndq;
+  TH1F *hptjetdpdq;
+  TH2F *hdqvjet;
+  TH1F *hdRdqdq71;
+  TH2F *hpTdqdq71;
+  TH1F *hdaupt;
+  TH1F *hmapt;
+  TH1F *hnfstdau;
+  TH1F *hnfrstdau;
+  TH1F *hdecays;
+  TH1F *hdecays2;
+  TH1D *hfilter;
+
+  vector<TH1*> all;  // every histogram above, in booking order
+};
 
 
+// prefill puts the particle names on the hdecays axes (and one entry each),
+// which must only happen once for the set that ends up in the output file
+void BookHistograms(HVPlots *plots, bool prefill)
+{
   // Book histogram.
-  TH1F *hmultch = new TH1F("hmultch","charged multiplicity", 100, -0.5, 799.5);
-  TH1F *hmultneu = new TH1F("hmultneu","neutral multiplicity", 100, -0.5, 799.5);
-  TH1F *hppid = new TH1F("hppid","particle identification number", 1000, -500, 500);
+  plots->hmultch = new TH1F("hmultch","charged multiplicity", 100, -0.5, 799.5);
+  plots->hmultneu = new TH1F("hmultneu","neutral multiplicity", 100, -0.5, 799.5);
+  plots->hppid = new TH1F("hppid","particle identification number", 1000, -500, 500);
   // dark scalar mediator 4900001
   // dark gluon 4900021
   // dark scalar quark 4900101
   // dark scalar pion 4900111
   // dark scalar rho 4900113
-  TH1F *hppidHV = new TH1F("hppidHV","particle identification number-490000", 400, -200., 200.);
-  TH1F *hppid2HV = new TH1F("hppid2HV","particle identification number-490000 if has stable daughter", 400, -200., 200.);
-  TH1F *hppid2ddg = new TH1F("hppid2ddg","particle identification number-490000 dark gluon daughters", 400, -200., 200.);
-  TH2F *hmassHV = new TH2F("hmassHV","mass versus id-4900000",300,-150.,150.,1000,-20.,1500.);
-  TH2F *hqHV = new TH2F("hqHV","charge versus id-4900000",300,-150.,150.,40,-2.,2.);
-  TH1F *hmHV = new TH1F("hmHV","particle mass HV", 5000, 0., 5000.);
-  TH1F *hm2HV = new TH1F("hm2HV","particle mass HV", 200, 0., 50.);
-  TH1F *hd0HV = new TH1F("hd0HV","r decay HV",200,0.,0.1);
-  TH1F *hd0gHV = new TH1F("hd0gHV","decay length over gamma HV stable daughter",200,0.,600);
-  TH1F *ht0HV = new TH1F("ht0HV","t decay HV over gamma",200,0.,0.1);
-  TH1F *hd0dHV = new TH1F("hd0dHV","r decay HV stable daughter",200,0.,1000.);
-  TH2F *hd0d2HV = new TH2F("hd0d2HV","r decay HV stable daughter versus mom id",200,0.,200.,200,0.,1500.);
-  TH1F *hstatus = new TH1F("hstatus","particle status HV",200,-100.,100.);
-  TH1F *hstatus2 = new TH1F("hstatus2","particle status HV ndau<2",200,-100.,100.);
-  TH1F *hndau = new TH1F("hndau","number daughters HV",100,0.,50.);
-  TH1F *hnsdau = new TH1F("hnsdau","number stable daughters HV",100,0.,50.);
-  TH1F *hd0HVs1 = new TH1F("hd0HVs1","r decay first stable daughter of HV",100,0.,1000.);
-  TH2F *hndau2 = new TH2F("hndau2","number of daughters veruss parent ID-4900000",200,0.,200.,50,0.,50.);
-  TH1F *hndpis = new TH1F("hndpis","number HV with a  stable daughter in event",100,0.,100.);
-  TH1F *hnjet = new TH1F("hnjet"," number jets",50,0.,50.);
-  TH1F *hjetpT = new TH1F("hjetpT","jet pT",100,0.,1000.);
-  TH1F *hjet1pT = new TH1F("hjet1pT","jet pT",100,0.,1000.);
-  TH1F *hjet2pT = new TH1F("hjet2pT","jet pT",100,0.,1000.);
-  TH1F *hjet3pT = new TH1F("hjet3pT","jet pT",100,0.,1000.);
-  TH1F *hjet4pT = new TH1F("hjet4pT","jet pT",100,0.,1000.);
-  TH1F *hjety = new TH1F("hjety","jet y",50,-5.,5.);
-  TH1F *hjetphi = new TH1F("hjetphi","jet phi",50,-4.,7.);
-  TH1F *hndqs = new TH1F("hndqs","number dark quarks",50,0.,50.);
-  TH1F *hndq71 = new TH1F("hndq71","number dark quarks code 71",50,0.,50.);
-  TH1F *hndqnm = new TH1F("hndqnm","number dark quarks without dark quark mother",50,0.,50.);
-  TH1F *hdRdqj = new TH1F("hdRdqj","delta R between dark quark and matching jet ",100,0.,5.);
-  TH1F *hdRdj = new TH1F("hdRdj","delta R between down quark and matching jet ",100,0.,5.);
-  TH1F *htright = new TH1F("htright","trigger ht",500,0.,5000.);
-  TH1F *hcutflow = new TH1F("hcutflow","cut flow",20,0.,20.);
-  TH1F *hdRdpisdjet = new TH1F("hdRdpisdjet","delta R between dark quark and dark pions ",100,0.,5.);
-  TH1F *hnjetdpi = new TH1F("hnjetdpi","number of jets containing a dark pi",50,0.,50.);
-  TH1F *hndpipj = new TH1F("hndpipj","number of dark pis per jet",50,0.,50.);
-  TH1F *hptjetdp = new TH1F("hptjetdp","pt of jets with a dark pi",500,0.,1000.);
-  TH1F *hndpipjndq = new TH1F("hndpipjndq","number of dark pis per jet jet not matched dq",50,0.,50.);
-  TH1F *hndpipjdq = new TH1F("hndpipjdq","number of dark pis per jet jet matched dq",50,0.,50.);
-  TH1F *hndpipjd = new TH1F("hndpipjd","number of dark pis per jet jet matched d",50,0.,50.);
-  TH1F *hdppt = new TH1F("hdppt","pt spectra of dark pions",50,0.,50.);
-  TH1F *hptjetdpndq = new TH1F("hptjetdpndq","pt of jets with a dark pi not matched dq",500,0.,1000.);
-  TH1F *hptjetdpdq = new TH1F("hptjetdpdq","pt of jets with a dark pi matched dq",500,0.,1000.);
-  TH2F *hdqvjet = new TH2F("hdqvjet"," pt of dark quark versus matched jet",500,0.,1000.,500,0.,1000.);
-  TH1F *hdRdqdq71 = new TH1F("hdRdqdq71","delta R between dark quark and dark quark 71 ",100,0.,5.);
-  TH2F *hpTdqdq71 = new TH2F("hpTdqdq71"," pt of dark quark versus dark quark 71",500,0.,1000.,500,0.,1000.);
-
-  TH1F *hdaupt = new TH1F("hdaupt"," pT of stable daughters",50,0.,10.);
-  TH1F *hmapt = new TH1F("hmapt"," pT of mother",50,0.,100.);
-  TH1F *hnfstdau = new TH1F("hnfstdau"," number of stable daughters ",50,0.,50.);
-  TH1F *hnfrstdau = new TH1F("hnfrstdau"," number of first daughters dark pi",50,0.,50.);
+  plots->hppidHV = new TH1F("hppidHV","particle identification number-490000", 400, -200., 200.);
+  plots->hppid2HV = new TH1F("hppid2HV","particle identification number-490000 if has stable daughter", 400, -200., 200.);
+  plots->hppid2ddg = new TH1F("hppid2ddg","particle identification number-490000 dark gluon daughters", 400, -200., 200.);
+  plots->hmassHV = new TH2F("hmassHV","mass versus id-4900000",300,-150.,150.,1000,-20.,1500.);
+  plots->hqHV = new TH2F("hqHV","charge versus id-4900000",300,-150.,150.,40,-2.,2.);
+  plots->hmHV = new TH1F("hmHV","particle mass HV", 5000, 0., 5000.);
+  plots->hm2HV = new TH1F("hm2HV","particle mass HV", 200, 0., 50.);
+  plots->hd0HV = new TH1F("hd0HV","r decay HV",200,0.,0.1);
+  plots->hd0gHV = new TH1F("hd0gHV","decay length over gamma HV stable daughter",200,0.,600);
+  plots->ht0HV = new TH1F("ht0HV","t decay HV over gamma",200,0.,0.1);
+  plots->hd0dHV = new TH1F("hd0dHV","r decay HV stable daughter",200,0.,1000.);
+  plots->hd0d2HV = new TH2F("hd0d2HV","r decay HV stable daughter versus mom id",200,0.,200.,200,0.,1500.);
+  plots->hstatus = new TH1F("hstatus","particle status HV",200,-100.,100.);
+  plots->hstatus2 = new TH1F("hstatus2","particle status HV ndau<2",200,-100.,100.);
+  plots->hndau = new TH1F("hndau","number daughters HV",100,0.,50.);
+  plots->hnsdau = new TH1F("hnsdau","number stable daughters HV",100,0.,50.);
+  plots->hd0HVs1 = new TH1F("hd0HVs1","r decay first stable daughter of HV",100,0.,1000.);
+  plots->hndau2 = new TH2F("hndau2","number of daughters veruss parent ID-4900000",200,0.,200.,50,0.,50.);
+  plots->hndpis = new TH1F("hndpis","number HV with a  stable daughter in event",100,0.,100.);
+  plots->hnjet = new TH1F("hnjet"," number jets",50,0.,50.);
+  plots->hjetpT = new TH1F("hjetpT","jet pT",100,0.,1000.);
+  plots->hjet1pT = new TH1F("hjet1pT","jet pT",100,0.,1000.);
+  plots->hjet2pT = new TH1F("hjet2pT","jet pT",100,0.,1000.);
+  plots->hjet3pT = new TH1F("hjet3pT","jet pT",100,0.,1000.);
+  plots->hjet4pT = new TH1F("hjet4pT","jet pT",100,0.,1000.);
+  plots->hjety = new TH1F("hjety","jet y",50,-5.,5.);
+  plots->hjetphi = new TH1F("hjetphi","jet phi",50,-4.,7.);
+  plots->hndqs = new TH1F("hndqs","number dark quarks",50,0.,50.);
+  plots->hndq71 = new TH1F("hndq71","number dark quarks code 71",50,0.,50.);
+  plots->hndqnm = new TH1F("hndqnm","number dark quarks without dark quark mother",50,0.,50.);
+  plots->hdRdqj = new TH1F("hdRdqj","delta R between dark quark and matching jet ",100,0.,5.);
+  plots->hdRdj = new TH1F("hdRdj","delta R between down quark and matching jet ",100,0.,5.);
+  plots->htright = new TH1F("htright","trigger ht",500,0.,5000.);
+  plots->hcutflow = new TH1F("hcutflow","cut flow",20,0.,20.);
+  plots->hdRdpisdjet = new TH1F("hdRdpisdjet","delta R between dark quark and dark pions ",100,0.,5.);
+  plots->hnjetdpi = new TH1F("hnjetdpi","number of jets containing a dark pi",50,0.,50.);
+  plots->hndpipj = new TH1F("hndpipj","number of dark pis per jet",50,0.,50.);
+  plots->hptjetdp = new TH1F("hptjetdp","pt of jets with a dark pi",500,0.,1000.);
+  plots->hndpipjndq = new TH1F("hndpipjndq","number of dark pis per jet jet not matched dq",50,0.,50.);
+  plots->hndpipjdq = new TH1F("hndpipjdq","number of dark pis per jet jet matched dq",50,0.,50.);
+  plots->hndpipjd = new TH1F("hndpipjd","number of dark pis per jet jet matched d",50,0.,50.);
+  plots->hdppt = new TH1F("hdppt","pt spectra of dark pions",50,0.,50.);
+  plots->hptjetdpndq = new TH1F("hptjetdpndq","pt of jets with a dark pi not matched dq",500,0.,1000.);
+  plots->hptjetdpdq = new TH1F("hptjetdpdq","pt of jets with a dark pi matched dq",500,0.,1000.);
+  plots->hdqvjet = new TH2F("hdqvjet"," pt of dark quark versus matched jet",500,0.,1000.,500,0.,1000.);
+  plots->hdRdqdq71 = new TH1F("hdRdqdq71","delta R between dark quark and dark quark 71 ",100,0.,5.);
+  plots->hpTdqdq71 = new TH2F("hpTdqdq71"," pt of dark quark versus dark quark 71",500,0.,1000.,500,0.,1000.);
+
+  plots->hdaupt = new TH1F("hdaupt"," pT of stable daughters",50,0.,10.);
+  plots->hmapt = new TH1F("hmapt"," pT of mother",50,0.,100.);
+  plots->hnfstdau = new TH1F("hnfstdau"," number of stable daughters ",50,0.,50.);
+  plots->hnfrstdau = new TH1F("hnfrstdau"," number of first daughters dark pi",50,0.,50.);
 
   
-  TH1F *hdecays = new TH1F("hdecays"," decays ",3,0,3);
-  hdecays->SetStats(0);
-  hdecays->SetCanExtend(TH1::kAllAxes);
-  for(int ij=0;ij<npart;ij++) {
-    hdecays->Fill(partNames[ij],1);
+  plots->hdecays = new TH1F("hdecays"," decays ",3,0,3);
+  plots->hdecays->SetStats(0);
+  plots->hdecays->SetCanExtend(TH1::kAllAxes);
+  if(prefill) {
+    for(int ij=0;ij<npart;ij++) {
+      plots->hdecays->Fill(partNames[ij],1);
+    }
   }
 
 
-  TH1F *hdecays2 = new TH1F("hdecays2"," decays2 ",3,0,3);
-  hdecays2->SetStats(0);
-  hdecays2->SetCanExtend(TH1::kAllAxes);
-  for(int ij=0;ij<npart;ij++) {
-    hdecays2->Fill(partNames[ij],1);
+  plots->hdecays2 = new TH1F("hdecays2"," decays2 ",3,0,3);
+  plots->hdecays2->SetStats(0);
+  plots->hdecays2->SetCanExtend(TH1::kAllAxes);
+  if(prefill) {
+    for(int ij=0;ij<npart;ij++) {
+      plots->hdecays2->Fill(partNames[ij],1);
+    }
   }
+
+  // bookkeeping of the generator-level filter, for the normalization
+  plots->hfilter = new TH1D("hfilter","generator filter",6,0.,6.);
+  plots->hfilter->Sumw2();
+  plots->hfilter->GetXaxis()->SetBinLabel(1,"generated");
+  plots->hfilter->GetXaxis()->SetBinLabel(2,"accepted");
+  plots->hfilter->GetXaxis()->SetBinLabel(3,"sumw generated");
+  plots->hfilter->GetXaxis()->SetBinLabel(4,"sumw accepted");
+  plots->hfilter->GetXaxis()->SetBinLabel(5,"sigmaGen (mb)");
+  plots->hfilter->GetXaxis()->SetBinLabel(6,"sigma accepted (mb)");
   
 
+  plots->all.push_back(plots->hmultch);
+  plots->all.push_back(plots->hmultneu);
+  plots->all.push_back(plots->hppid);
+  plots->all.push_back(plots->hppidHV);
+  plots->all.push_back(plots->hppid2HV);
+  plots->all.push_back(plots->hppid2ddg);
+  plots->all.push_back(plots->hmassHV);
+  plots->all.push_back(plots->hqHV);
+  plots->all.push_back(plots->hmHV);
+  plots->all.push_back(plots->hm2HV);
+  plots->all.push_back(plots->hd0HV);
+  plots->all.push_back(plots->hd0gHV);
+  plots->all.push_back(plots->ht0HV);
+  plots->all.push_back(plots->hd0dHV);
+  plots->all.push_back(plots->hd0d2HV);
+  plots->all.push_back(plots->hstatus);
+  plots->all.push_back(plots->hstatus2);
+  plots->all.push_back(plots->hndau);
+  plots->all.push_back(plots->hnsdau);
+  plots->all.push_back(plots->hd0HVs1);
+  plots->all.push_back(plots->hndau2);
+  plots->all.push_back(plots->hndpis);
+  plots->all.push_back(plots->hnjet);
+  plots->all.push_back(plots->hjetpT);
+  plots->all.push_back(plots->hjet1pT);
+  plots->all.push_back(plots->hjet2pT);
+  plots->all.push_back(plots->hjet3pT);
+  plots->all.push_back(plots->hjet4pT);
+  plots->all.push_back(plots->hjety);
+  plots->all.push_back(plots->hjetphi);
+  plots->all.push_back(plots->hndqs);
+  plots->all.push_back(plots->hndq71);
+  plots->all.push_back(plots->hndqnm);
+  plots->all.push_back(plots->hdRdqj);
+  plots->all.push_back(plots->hdRdj);
+  plots->all.push_back(plots->htright);
+  plots->all.push_back(plots->hcutflow);
+  plots->all.push_back(plots->hdRdpisdjet);
+  plots->all.push_back(plots->hnjetdpi);
+  plots->all.push_back(plots->hndpipj);
+  plots->all.push_back(plots->hptjetdp);
+  plots->all.push_back(plots->hndpipjndq);
+  plots->all.push_back(plots->hndpipjdq);
+  plots->all.push_back(plots->hndpipjd);
+  plots->all.push_back(plots->hdppt);
+  plots->all.push_back(plots->hptjetdpndq);
+  plots->all.push_back(plots->hptjetdpdq);
+  plots->all.push_back(plots->hdqvjet);
+  plots->all.push_back(plots->hdRdqdq71);
+  plots->all.push_back(plots->hpTdqdq71);
+  plots->all.push_back(plots->hdaupt);
+  plots->all.push_back(plots->hmapt);
+  plots->all.push_back(plots->hnfstdau);
+  plots->all.push_back(plots->hnfrstdau);
+  plots->all.push_back(plots->hdecays);
+  plots->all.push_back(plots->hdecays2);
+  plots->all.push_back(plots->hfilter);
+}
+
+
+// add the worker histograms to plots, in worker order so the sums are reproducible
+void MergeHistograms(HVPlots *plots, vector<HVPlots*> &workerPlots)
+{
+  for(unsigned ih=0;ih<plots->all.size();ih++) {
+    TList list;
+    for(unsigned iw=0;iw<workerPlots.size();iw++) list.Add(workerPlots[iw]->all[ih]);
+    plots->all[ih]->Merge(&list);
+  }
+}
+
 
-  // initialize slowjet
-  SlowJet aSlowJet(-1,0.4,35.,2.5,2,1); // power, R, ptjetmin, etamax, which particle, mass
-  // initialize trigger slow jet
-  SlowJet trigSlowJet(-1,0.4,40.,3.0,2,1); // power, R, ptjetmin, etamax, which particle, mass
+void WriteHistograms(HVPlots *plots)
+{
+  plots->hdppt->Write();
+  plots->hdRdqdq71->Write();
+  plots->hpTdqdq71->Write();
+  plots->hdqvjet->Write();
+  plots->hnjetdpi->Write();
+  plots->hndpipj->Write();
+  plots->hndpipjndq->Write();
+  plots->hndpipjdq->Write();
+  plots->hndpipjd->Write();
+  plots->hptjetdp->Write();
+  plots->hptjetdpndq->Write();
+  plots->hptjetdpdq->Write();
+  plots->hdRdpisdjet->Write();
+  plots->htright->Write();
+  plots->hcutflow->Write();
+  plots->hdRdqj->Write();
+  plots->hdRdj->Write();
+  plots->hppid2ddg->Write();
+  plots->hndpis->Write();
+  plots->hndqs->Write();
+  plots->hndq71->Write();
+  plots->hndqnm->Write();
+  plots->hmultch->Write();
+  plots->hmultneu->Write();
+  plots->hppid->Write();
+  plots->hppidHV->Write();
+  plots->hppid2HV->Write();
+  plots->hmassHV->Write();
+  plots->hqHV->Write();
+  plots->hmHV->Write();
+  plots->hm2HV->Write();
+  plots->hd0HV->Write();
+  plots->hd0gHV->Write();
+  plots->ht0HV->Write();
+  plots->hd0dHV->Write();
+  plots->hd0d2HV->Write();
+  plots->hstatus->Write();
+  plots->hstatus2->Write();
+  plots->hndau->Write();
+  plots->hnsdau->Write();
+  plots->hd0HVs1->Write();
+  plots->hndau2->Write();
+  plots->hnjet->Write();
+  plots->hjetpT->Write();
+  plots->hjet1pT->Write();
+  plots->hjet2pT->Write();
+  plots->hjet3pT->Write();
+  plots->hjet4pT->Write();
+  plots->hjety->Write();
+  plots->hjetphi->Write();
 
-  //delete jets outside of acceptance
   
+  plots->hdecays->LabelsDeflate();
+  plots->hdecays->LabelsOption("v");
+  plots->hdecays->LabelsOption("a");
+  plots->hdecays->Write();
 
 
-  // Begin event loop. Generate event; skip if generation aborted.
+  plots->hdecays2->LabelsDeflate();
+  plots->hdecays2->LabelsOption("v");
+  plots->hdecays2->LabelsOption("a");
+  plots->hdecays2->Write();
+  
+  plots->hdaupt->Write();
+  plots->hmapt->Write();
+  plots->hnfstdau->Write();
+  plots->hnfrstdau->Write();
+  plots->hfilter->Write();
+}
+
 
+// the dark sector parameters of the run, its cross section and the card,
+// so that the outputs of a parameter scan describe themselves
+void WriteParameters(Pythia &pythia, const string &filename, double sigmaGen, double sigmaAcc)
+{
+  TTree *tree = new TTree("parameters","model parameters and cross section");
+  double mFv = pythia.particleData.m0(4900001);
+  double mqv = pythia.particleData.m0(4900101);
+  double mpiv = pythia.particleData.m0(4900111);
+  double taupiv = pythia.particleData.tau0(4900111);
+  double lambda = pythia.parm("HiddenValley:Lambda");
+  int nEvent = pythia.mode("Main:numberOfEvents");
+  tree->Branch("mFv",&mFv,"mFv/D");
+  tree->Branch("mqv",&mqv,"mqv/D");
+  tree->Branch("mpiv",&mpiv,"mpiv/D");
+  tree->Branch("taupiv",&taupiv,"taupiv/D");
+  tree->Branch("Lambda",&lambda,"Lambda/D");
+  tree->Branch("nEvent",&nEvent,"nEvent/I");
+  tree->Branch("sigmaGen",&sigmaGen,"sigmaGen/D");
+  tree->Branch("sigmaAcc",&sigmaAcc,"sigmaAcc/D");
+  tree->Fill();
+  tree->Write();
+
+  ifstream in(filename.c_str());
+  stringstream card;
+  card << in.rdbuf();
+  TNamed("card", card.str().c_str()).Write();
+}
 
+
+// hands out turns in event order, so that events generated in different
+// threads reach the HepMC file in the same order as in a serial run
+class EventSequencer
+{
+public:
+  EventSequencer() : next(0) {}
+  void Start(int iEvent) { next = iEvent; }
+  void Wait(int iEvent) {
+    unique_lock<mutex> lock(mtx);
+    turn.wait(lock, [&]{ return next==iEvent; });
+  }
+  void Done() {
+    {
+      lock_guard<mutex> lock(mtx);
+      next++;
+    }
+    turn.notify_all();
+  }
+private:
+  mutex mtx;
+  condition_variable turn;
+  int next;
+};
+
+
+// stops the workers at every checkpoint event. The workers call Arrive()
+// before each round of events (iBlock = iEvent-iWorker) and Leave() at the
+// end; when all are stopped, every event before iBlock has been generated
+// and written, and the last worker to arrive saves the checkpoint
+class CheckpointBarrier
+{
+public:
+  CheckpointBarrier(int every, int first, int nWorkers, function<void(int)> save)
+    : fEvery(every), fFirst(first), fNWorkers(nWorkers), fSave(save),
+      fArrived(0), fLeft(0), fRound(0), fPending(0) {}
+
+  void Arrive(int iBlock) {
+    if(iBlock==fFirst || iBlock%fEvery!=0) return;
+    unique_lock<mutex> lock(fMutex);
+    int round = fRound;
+    fArrived++;
+    fPending = iBlock;
+    if(fArrived+fLeft==fNWorkers) Release();
+    else fAll.wait(lock, [&]{ return fRound!=round; });
+  }
+  void Leave() {
+    lock_guard<mutex> lock(fMutex);
+    fLeft++;
+    if(fArrived>0 && fArrived+fLeft==fNWorkers) Release();
+  }
+private:
+  void Release() {
+    fSave(fPending);
+    fArrived = 0;
+    fRound++;
+    fAll.notify_all();
+  }
+  int fEvery, fFirst, fNWorkers;
+  function<void(int)> fSave;
+  int fArrived, fLeft, fRound, fPending;
+  mutex fMutex;
+  condition_variable fAll;
+};
+
+
+// A checkpoint is a manifest (Main:checkpointFile) naming the next event,
+// the events written and the HepMC file size, plus per checkpoint a ROOT
+// file with the histograms of every worker and the random number state of
+// every worker. The manifest is replaced last, so it always points to a
+// complete checkpoint.
+struct Checkpoint
+{
+  int nextEvent;
+  int nWritten;
+  int nThreads;
+  long long hepmcOffset;
+  vector<long> nAccepted;   // per worker, for the cross section
+  vector<double> sigmaGen;
+
+  Checkpoint() : nextEvent(0), nWritten(0), nThreads(0), hepmcOffset(-1) {}
+
+  static string DataName(const string &base, int iEvent, const string &what) {
+    return base+"_"+to_string(iEvent)+what;
+  }
+
+  bool Read(const string &base) {
+    ifstream in(base.c_str());
+    if(!in) return false;
+    string key;
+    while(in>>key) {
+      if(key=="nextEvent") in>>nextEvent;
+      else if(key=="nWritten") in>>nWritten;
+      else if(key=="nThreads") in>>nThreads;
+      else if(key=="hepmcOffset") in>>hepmcOffset;
+      else if(key=="worker") {
+        int iw; long n; double sigma;
+        in>>iw>>n>>sigma;
+        nAccepted.push_back(n);
+        sigmaGen.push_back(sigma);
+      } else getline(in,key);
+    }
+    return nThreads>0 && (int)nAccepted.size()==nThreads;
+  }
+
+  bool Write(const string &base) {
+    string tmp = base+".tmp";
+    {
+      ofstream out(tmp.c_str());
+      out<<"nextEvent "<<nextEvent<<endl;
+      out<<"nWritten "<<nWritten<<endl;
+      out<<"nThreads "<<nThreads<<endl;
+      out<<"hepmcOffset "<<hepmcOffset<<endl;
+      out.precision(12);
+      for(int iw=0;iw<nThreads;iw++) out<<"worker "<<iw<<" "<<nAccepted[iw]<<" "<<sigmaGen[iw]<<endl;
+      if(!out) return false;
+    }
+    return rename(tmp.c_str(), base.c_str())==0;
+  }
+
+  void Remove(const string &base) {
+    remove(DataName(base,nextEvent,".root").c_str());
+    for(int iw=0;iw<nThreads;iw++) remove(DataName(base,nextEvent,".rndm"+to_string(iw)).c_str());
+  }
+};
+
+
+void SaveCheckpointHistograms(const string &fileName, vector<HVPlots*> &workerPlots)
+{
+  TFile f(fileName.c_str(), "RECREATE");
+  for(unsigned iw=0;iw<workerPlots.size();iw++) {
+    TDirectory *dir = f.mkdir(("worker"+to_string(iw)).c_str());
+    dir->cd();
+    for(unsigned ih=0;ih<workerPlots[iw]->all.size();ih++) workerPlots[iw]->all[ih]->Write();
+  }
+  f.Close();
+}
+
+
+// the histograms must be booked empty (no prefill)
+bool LoadCheckpointHistograms(const string &fileName, vector<HVPlots*> &workerPlots)
+{
+  TFile *f = TFile::Open(fileName.c_str());
+  if(!f || f->IsZombie()) return false;
+  bool ok = true;
+  for(unsigned iw=0;iw<workerPlots.size() && ok;iw++) {
+    TDirectory *dir = f->GetDirectory(("worker"+to_string(iw)).c_str());
+    if(!dir) { ok = false; break; }
+    for(unsigned ih=0;ih<workerPlots[iw]->all.size();ih++) {
+      TH1 *h = (TH1*) dir->Get(workerPlots[iw]->all[ih]->GetName());
+      if(!h) { ok = false; break; }
+      TList list;
+      list.Add(h);
+      workerPlots[iw]->all[ih]->Merge(&list);
+      delete h;
+    }
+  }
+  delete f;
+  return ok;
+}
+
+
+// custom settings must be declared before the card is read
+void ConfigurePythia(Pythia &pythia, string filename)
+{
+  pythia.settings.addMode("Main:numberOfThreads",1,true,false,1,0);
+  pythia.settings.addMode("Main:checkpointEvery",0,true,false,0,0);
+  pythia.settings.addFlag("Main:timing",false);
+  pythia.settings.addWord("Main:checkpointFile","pythiaTree.ckpt");
+  AddHepMCOutputSettings(pythia.settings);
+  AddDelphesSettings(pythia.settings);
+  pythia.settings.addFlag("Filter:on",false);
+  pythia.settings.addWord("Filter:card","");
+  pythia.settings.addParm("Filter:trigHTMin",0.,true,false,0.,0.);
+  pythia.settings.addMode("Filter:nJetMin",0,true,false,0,0);
+  pythia.settings.addParm("Filter:jet1PtMin",0.,true,false,0.,0.);
+  pythia.settings.addParm("Filter:jet2PtMin",0.,true,false,0.,0.);
+  pythia.settings.addParm("Filter:jet3PtMin",0.,true,false,0.,0.);
+  pythia.settings.addParm("Filter:jet4PtMin",0.,true,false,0.,0.);
+  pythia.readFile(filename);
+  // the filter cuts may also come from a side card
+  if(pythia.word("Filter:card")!="") pythia.readFile(pythia.word("Filter:card"));
+}
+
+
+// loose generator-level preselection, applied before the HepMC/Delphes output.
+// The cuts should stay looser than the ones of the analysis (emgD.C)
+struct GenFilter
+{
+  bool on;
+  float trigHTMin;
+  int nJetMin;
+  float jetPtMin[4];
+
+  GenFilter(Pythia &pythia) {
+    on = pythia.flag("Filter:on");
+    trigHTMin = pythia.parm("Filter:trigHTMin");
+    nJetMin = pythia.mode("Filter:nJetMin");
+    jetPtMin[0] = pythia.parm("Filter:jet1PtMin");
+    jetPtMin[1] = pythia.parm("Filter:jet2PtMin");
+    jetPtMin[2] = pythia.parm("Filter:jet3PtMin");
+    jetPtMin[3] = pythia.parm("Filter:jet4PtMin");
+  }
+
+  bool Pass(JetView &aSlowJet, JetView &trigSlowJet) {
+    if(!on) return true;
+    float trigHT=0.;
+    for (int ijet =0; ijet< trigSlowJet.sizeJet(); ++ijet) {
+      trigHT=trigHT+trigSlowJet.pT(ijet);
+    }
+    if(trigHT<trigHTMin) return false;
+    if(aSlowJet.sizeJet()<nJetMin) return false;
+    // a jet pT cut on jet n also requires n jets
+    for(int ijet=0;ijet<4;ijet++) {
+      if(jetPtMin[ijet]<=0.) continue;
+      if(aSlowJet.sizeJet()<=ijet || aSlowJet.pT(ijet)<jetPtMin[ijet]) return false;
+    }
+    return true;
+  }
+};
+
+
+// print the HV part of the decay tree of a dark quark: its daughters, and
+// below them all unstable HV particles
+void PrintDarkQuarkTree(int iq, int dq, float dqy, float dqphi, Event &event, EventGraph &graph)
+{
+  cout<<"beginning dark quark "<<iq<<" "<<dq<<endl;
+  vector<int> tree(1, dq);
+  graph.NewSearch();
+  for(const int *d=graph.DaughterBegin(dq); d!=graph.DaughterEnd(dq); ++d) {
+    if(*d<0 || *d==dq) continue;
+    graph.Collect(*d, tree, [&](int j) {
+        return !event[j].isFinal() && abs(event[j].id())>4900000; });
+  }
+  sort(tree.begin(), tree.end());
+  cout<<" id mothers daughters pt y phi deltaR"<<endl;
+  for(size_t k=0;k<tree.size();++k) {
+    int kk = tree[k];
+    float aaatmp=DeltaR(dqy,dqphi,event[kk].y(),event[kk].phi());
+    cout<<kk<<" "<<event[kk].id()<<" "<<event[kk].mother1()<<" "<<event[kk].mother2()<<" "<<
+      event[kk].daughter1()<<" "<<event[kk].daughter2()<<" "<<
+      event[kk].pT()<<" "<<event[kk].y()<<" "<<event[kk].phi()<<" "<<aaatmp<<endl;
+  }
+}
+
+
+// analysis of one generated event
+// The event graph and the jets must be made before
+void AnalyseEvent(int iEvent, Event &event, EventGraph &graph,
+                  JetView &aSlowJet, JetView &trigSlowJet,
+                  HVPlots *plots, const PdgIndex &pdgNum, EventBuffers &buf, ofstream &outPut)
+{
+  int nCharged, nNeutral, nTot;
   int ndpis,ndqs,ndq71,ndqnm,m1,m2,ipid,dq1,dq2,d1,d2;
   int dq711,dq712;
 
@@ -217,7 +710,7 @@ for(int hh=0;hh<1000;hh++) {
   float dq2pT,dq2y,dq2phi;
   float d1pT,d1y,d1phi;
   float d2pT,d2y,d2phi;
-  float dq1dR,dq2dR,d1dR,d2dR,aaatmp,aaatmp2;
+  float dq1dR,dq2dR,d1dR,d2dR,aaatmp;
   int dq1sj,dq2sj,d1sj,d2sj;
   int nfstdau; 
   int nfrstdau; 
@@ -225,13 +718,6 @@ for(int hh=0;hh<1000;hh++) {
   int ndpismax=100;
   int ptdpis[100];
 
-  cout<<"test test"<<endl;
-
-  for (int iEvent = 0; iEvent < nEvent; ++iEvent) {
-    if(idsp>0) outPut<<"New Event "<<iEvent<<endl;
-
-    if (!pythia.next()) continue;
-
     if(idbg>0) {
       std::cout<<endl;
       std::cout<<endl;
@@ -240,10 +726,6 @@ for(int hh=0;hh<1000;hh++) {
       std::cout<<"Will Robinson New Event "<<iEvent<<std::endl;
     }
 
-    // do jet finding for this event
-    aSlowJet.analyze(pythia.event );
-    trigSlowJet.analyze(pythia.event );
-
     // Find number of all final charged particles.
     nCharged = 0;  // for counting the number of stable charged particles in the event
     nNeutral = 0;  // ditto neutral
@@ -260,37 +742,37 @@ for(int hh=0;hh<1000;hh++) {
     dq712=0;
 
 
-    for (int i = 0; i < pythia.event.size(); ++i) {  // loop over all particles in the event
-      //      std::cout<<pythia.event[i].isCharged()<<endl;
+    for (int i = 0; i < event.size(); ++i) {  // loop over all particles in the event
+      //      std::cout<<event[i].isCharged()<<endl;
 
       //  look at dark quarks
-      if(abs(pythia.event[i].id())==4900101) {
+      if(abs(event[i].id())==4900101) {
 	ndqs++;  // count number of dark quarks in event
 	// look for dark quarks that do not have a dark quark daughter
-        m1=pythia.event[i].mother1();
-	m2=pythia.event[i].mother2();
-	if( (abs(pythia.event[m1].id())!=4900101) && (abs(pythia.event[m2].id())!=4900101) ) {
+        m1=event[i].mother1();
+	m2=event[i].mother2();
+	if( (abs(event[m1].id())!=4900101) && (abs(event[m2].id())!=4900101) ) {
 	  ndqnm++;
 	  if(dq1==0) {
 	    dq1=i;
-	    if(abs(pythia.event[pythia.event[m1].daughter1()].id())==1) {
-	      d1=pythia.event[m1].daughter1();
+	    if(abs(event[event[m1].daughter1()].id())==1) {
+	      d1=event[m1].daughter1();
 	    } else{
-	      d1=pythia.event[m1].daughter2();
+	      d1=event[m1].daughter2();
 	    }
 	  } else {
 	    dq2=i;
-	    if(abs(pythia.event[pythia.event[m1].daughter1()].id())==1) {
-	      d2=pythia.event[m1].daughter1();
+	    if(abs(event[event[m1].daughter1()].id())==1) {
+	      d2=event[m1].daughter1();
 	    } else{
-	      d2=pythia.event[m1].daughter2();
+	      d2=event[m1].daughter2();
 	    }
 	  }
 	}
 	// look for dark quarks with code 71
-	if(abs(pythia.event[i].status())==71) {
+	if(abs(event[i].status())==71) {
 	  ndq71++;
-	  if(idbg>0) cout<<" dark quark with code 71 is "<<i<<" "<<pythia.event[i].pT()<<" "<<pythia.event[i].y()<<" "<<pythia.event[i].phi()<<endl;
+	  if(idbg>0) cout<<" dark quark with code 71 is "<<i<<" "<<event[i].pT()<<" "<<event[i].y()<<" "<<event[i].phi()<<endl;
 	  if(dq711==0) {
 	    dq711=i;
 	  } else {
@@ -299,36 +781,36 @@ for(int hh=0;hh<1000;hh++) {
 	}
       }
       // look at all HV particles and make list of dark pions with stable daughters and put in ptdpise
-      if(abs(pythia.event[i].id())>4900000) {
-	int idHV = pythia.event[i].id();
-	float mHV = pythia.event[i].m();
-	float qHV = pythia.event[i].charge();
-        float d0HV = sqrt(pow(pythia.event[i].xProd(),2)+pow(pythia.event[i].yProd(),2));
-	float decayLHV = sqrt(pow(pythia.event[i].xProd(),2)+pow(pythia.event[i].yProd(),2)+pow(pythia.event[i].zProd(),2));
-	float massHV = sqrt( pow(pythia.event[i].e(),2) - pow(pythia.event[i].pAbs(),2));
-	float gammaHV = pythia.event[i].e()/ massHV;
-	float betaHV = pythia.event[i].pAbs()/pythia.event[i].e();
+      if(abs(event[i].id())>4900000) {
+	int idHV = event[i].id();
+	float mHV = event[i].m();
+	float qHV = event[i].charge();
+        float d0HV = sqrt(pow(event[i].xProd(),2)+pow(event[i].yProd(),2));
+	float decayLHV = sqrt(pow(event[i].xProd(),2)+pow(event[i].yProd(),2)+pow(event[i].zProd(),2));
+	float massHV = sqrt( pow(event[i].e(),2) - pow(event[i].pAbs(),2));
+	float gammaHV = event[i].e()/ massHV;
+	float betaHV = event[i].pAbs()/event[i].e();
 	float decaypT = decayLHV/betaHV/3e10/gammaHV;
 	int ndauHV=0; 
-	if(pythia.event[i].daughter1()!=0) ndauHV=pythia.event[i].daughter2()-pythia.event[i].daughter1()+1;
+	if(event[i].daughter1()!=0) ndauHV=event[i].daughter2()-event[i].daughter1()+1;
 	if(idbg>8) std::cout<<" for particle "<<i<<" number of daughters is "<<ndauHV<<std::endl;
 	int HV = (idHV/abs(idHV))*(abs(idHV)-4900000);
-	hppidHV->Fill( HV);  // get the type of the particle
-        hmassHV->Fill( HV,mHV );
-        hqHV->Fill( HV,qHV );
-	hmHV->Fill(mHV);
-	hm2HV->Fill(mHV);
-	hd0HV->Fill(d0HV);
-
-	ht0HV->Fill(decaypT);
-	hstatus->Fill(pythia.event[i].status());
-	if(ndauHV<2) hstatus2->Fill(pythia.event[i].status());
-        hndau->Fill(ndauHV);
-        hndau2->Fill(abs(HV),ndauHV);
+	plots->hppidHV->Fill( HV);  // get the type of the particle
+        plots->hmassHV->Fill( HV,mHV );
+        plots->hqHV->Fill( HV,qHV );
+	plots->hmHV->Fill(mHV);
+	plots->hm2HV->Fill(mHV);
+	plots->hd0HV->Fill(d0HV);
+
+	plots->ht0HV->Fill(decaypT);
+	plots->hstatus->Fill(event[i].status());
+	if(ndauHV<2) plots->hstatus2->Fill(event[i].status());
+        plots->hndau->Fill(ndauHV);
+        plots->hndau2->Fill(abs(HV),ndauHV);
 	//what are the dark gluon daughters?
 	if(HV==21) {
-	  if(pythia.event[i].daughter1()!=0) hppid2ddg->Fill(pythia.event[pythia.event[i].daughter1()].id()-4900000);
-	  if(pythia.event[i].daughter2()!=0) hppid2ddg->Fill(pythia.event[pythia.event[i].daughter2()].id()-4900000);
+	  if(event[i].daughter1()!=0) plots->hppid2ddg->Fill(event[event[i].daughter1()].id()-4900000);
+	  if(event[i].daughter2()!=0) plots->hppid2ddg->Fill(event[event[i].daughter2()].id()-4900000);
 	}
 	if(ndauHV>0) { // if it is not a stable HV particle
 	  if(idbg>8) std::cout<<"entering studies of unstable HVs"<<std::endl;
@@ -336,40 +818,40 @@ for(int hh=0;hh<1000;hh++) {
 	  //          if( abs(idHV)==4900113) {  // dark rho
 	  //	    cout<<"danger danger will robinson dark rho number daughters is "<<ndauHV<<endl;
 	  //  	    for(int ij=0; ij<ndauHV; ++ij) {
-	  //	      int iii = pythia.event[i].daughter1()+ij;
-	  //	      cout<<"daughter "<<ij<<" has id "<<pythia.event[iii].id()<<endl;
-	  //	      cout<<"mother momentum is "<<pythia.event[i].px()<<","<<pythia.event[i].py()<<","<<pythia.event[i].pz()<<endl;
-	  //	      cout<<"daught momentum is "<<pythia.event[iii].px()<<","<<pythia.event[iii].py()<<","<<pythia.event[iii].pz()<<endl;
+	  //	      int iii = event[i].daughter1()+ij;
+	  //	      cout<<"daughter "<<ij<<" has id "<<event[iii].id()<<endl;
+	  //	      cout<<"mother momentum is "<<event[i].px()<<","<<event[i].py()<<","<<event[i].pz()<<endl;
+	  //	      cout<<"daught momentum is "<<event[iii].px()<<","<<event[iii].py()<<","<<event[iii].pz()<<endl;
 	  //	    }
 	  //          }
 
 	  int nstable=0;
 	  int nHVdau=0;
 	  for(int ij=0; ij<ndauHV; ++ij) {  // loop over all the HV particle's daughters
-	    int iii = pythia.event[i].daughter1()+ij;
-	    int idauid = abs(pythia.event[iii].id());
+	    int iii = event[i].daughter1()+ij;
+	    int idauid = abs(event[iii].id());
 	    if(idauid>4900000) nHVdau++;
 	  
 
-	    if(pythia.event[iii].isFinal()) {  // for stable daughters of HV particles
-	      float d0dHV = sqrt(pow(pythia.event[iii].xProd(),2)+pow(pythia.event[iii].yProd(),2));
-	      float L0DHV = sqrt(pow(pythia.event[iii].xProd(),2)+pow(pythia.event[iii].yProd(),2)+pow(pythia.event[iii].zProd(),2) );
+	    if(event[iii].isFinal()) {  // for stable daughters of HV particles
+	      float d0dHV = sqrt(pow(event[iii].xProd(),2)+pow(event[iii].yProd(),2));
+	      float L0DHV = sqrt(pow(event[iii].xProd(),2)+pow(event[iii].yProd(),2)+pow(event[iii].zProd(),2) );
 
 	      if(nstable==0) { // if his a particle that is stable (first one)
-		hnsdau->Fill(pythia.event[i].daughter2()-pythia.event[i].daughter1());
-		hd0HVs1->Fill(d0dHV);
+		plots->hnsdau->Fill(event[i].daughter2()-event[i].daughter1());
+		plots->hd0HVs1->Fill(d0dHV);
 		ndpis++;  // count HV particles that have at least one stable daughter
 		nstable++;
-		if(ndpis<ndpismax) ptdpis[ndpis-1]=i;
- 	        hppid2HV->Fill(HV);
-	        hd0dHV->Fill(d0dHV);
-		if(abs(pythia.event[i].id())==4900111) { // dark pion
-		  hd0gHV->Fill(L0DHV/betaHV/gammaHV);
-		  hdppt->Fill(pythia.event[i].pT());
+		if(ndpis<=ndpismax) ptdpis[ndpis-1]=i;
+ 	        plots->hppid2HV->Fill(HV);
+	        plots->hd0dHV->Fill(d0dHV);
+		if(abs(event[i].id())==4900111) { // dark pion
+		  plots->hd0gHV->Fill(L0DHV/betaHV/gammaHV);
+		  plots->hdppt->Fill(event[i].pT());
 		}
-	        hd0d2HV->Fill(abs(HV),d0dHV);
+	        plots->hd0d2HV->Fill(abs(HV),d0dHV);
 		if(idbg>0) {
-		  std::cout<<" energy momentum mass beta gamma decayL are "<<pythia.event[i].e()<<" "<<pythia.event[i].pAbs()<<" "<<
+		  std::cout<<" energy momentum mass beta gamma decayL are "<<event[i].e()<<" "<<event[i].pAbs()<<" "<<
 		    massHV<<" "<<
 		    betaHV<<" "<<gammaHV<<" "<<L0DHV<<endl;
 		}
@@ -377,96 +859,49 @@ for(int hh=0;hh<1000;hh++) {
 	      }
 
 	      //	      if(idHV==4900021) {
-	      //		std::cout<<" danger will r: dark gluon with stable child "<<pythia.event[pythia.event[i].daughter1()+ij].id()<<std::endl;
-	      //		std::cout<<" daughters are "<<pythia.event[iii].daughter1()<<" "<<pythia.event[iii].daughter2()<<std::endl;
+	      //		std::cout<<" danger will r: dark gluon with stable child "<<event[event[i].daughter1()+ij].id()<<std::endl;
+	      //		std::cout<<" daughters are "<<event[iii].daughter1()<<" "<<event[iii].daughter2()<<std::endl;
 	      //	      }
 	    }	// end if final
 	  }  // end loop over HV daughters
 	  // for dark pions that have at least one stable daughter, make a pretty plot
-	  if(nstable>0&& abs(pythia.event[i].id())==4900111) {
+	  if(nstable>0&& abs(event[i].id())==4900111) {
 	  for(int ij=0; ij<ndauHV; ++ij) {  // loop over all the HV particle's daughters
-	    int iii = pythia.event[i].daughter1()+ij;
-	    hdecays->Fill(partNames[pdgNum[pythia.event[iii].id()]],1);
+	    int iii = event[i].daughter1()+ij;
+	    plots->hdecays->Fill(partNames[pdgNum[event[iii].id()]],1);
 	  }  // end loop over HV daughters
 	  }  //end if dark pion with stable daughters
-	  // find all the daughters 
-	  vector<int> ptalldau;
+	  // find all the stable descendants
 	  if(nHVdau==0) {  // if none of the daughters are another HV particle
-	    if(abs(idHV)==4900111) hnfrstdau->Fill( ndauHV );
+	    if(abs(idHV)==4900111) plots->hnfrstdau->Fill( ndauHV );
 	    if(idbg>1) 
-	    cout<<" making decay tree for particle "<<i<<" with number of daughters "<<ndauHV<<" and type "<<pythia.event[i].id()<<endl;
-	    hmapt->Fill(pythia.event[i].pT());
-	    for(int ij=0; ij<ndauHV; ++ij) {  // loop over all the HV particle's daughters
-	      int iii = pythia.event[i].daughter1()+ij;
-	      	      if(idbg>1) 
-	      std::cout<<"     adding particle "<<iii<<" with id "<<pythia.event[iii].id()<<endl;
-	      ptalldau.push_back(iii);
-	    }  // end loop over HV daughters
-	    bool stop=false;
-	    int isize,sizeold;
-            sizeold = 0;
-	    while(!stop) {
-	      isize = ptalldau.size();
-	            if(idbg>1) 
-std::cout<<"    current size is "<<isize<<std::endl;
-	    
-	      stop=true;
-	      	      if(idbg>1) 
-std::cout<<" size old isize is "<<sizeold<<" "<<isize<<std::endl;
-	      for(int hh=sizeold;hh<isize;hh++) {
-	        if(pythia.event[ptalldau[hh]].daughter1()!=0) {
-		  stop=false;
-	          int  idat = pythia.event[ptalldau[hh]].daughter2()-pythia.event[ptalldau[hh]].daughter1()+1;	      
-	          for(int jj=0;jj<idat;jj++) {
-		    ptalldau.push_back(pythia.event[ptalldau[hh]].daughter1()+jj);
-		    		    if(idbg>1) 
-std::cout<<" adding particle "<<pythia.event[ptalldau[hh]].daughter1()+jj<<" with id "<<pythia.event[ptalldau[hh]].id()<<std::endl;
-	          }
-		}
-	      }
-	      sizeold=isize;
-	      	      if(idbg>1) 
-std::cout<<" now sizeold is "<<sizeold<<std::endl;
-	      if(sizeold>500) {
-		std::cout<<" danger danger will robinson too many particles"<<std::endl;
-		stop=true;
-	      }
-	      	      if(idbg>1) 
-std::cout<<"  stop "<<stop<<std::endl;
-	    }
-	    	    if(idbg>1) 
-std::cout<<"now making stable daughters"<<std::endl;
-
-	    vector<int> ptstdau;
-	    isize = ptalldau.size();
-	    nfstdau=0;
-	    for(int hh=0;hh<isize;hh++) {
-	      // make a list of the stable one
-	      if(pythia.event[ptalldau[hh]].daughter1()==0) {
-                 std::vector<int>::iterator got3;
-		 got3 = std::find(ptstdau.begin(),ptstdau.end(),ptalldau[hh]);
-		 if(got3==ptstdau.end()) {
-                   ptstdau.push_back(ptalldau[hh]);
-		   nfstdau++;
-                   int ihaha2 = ((pythia.event[ptalldau[hh]]).id());
+	    cout<<" making decay tree for particle "<<i<<" with number of daughters "<<ndauHV<<" and type "<<event[i].id()<<endl;
+	    plots->hmapt->Fill(event[i].pT());
+
+	    // each stable particle once, in the order of the decay tree
+	    vector<int> &ptstdau = buf.ptstdau;
+	    graph.StableDescendants(i, ptstdau);
+	    int isize = ptstdau.size();
+	    nfstdau=isize;
+	    if(idbg>1) {
+	      for(int hh=0;hh<isize;hh++) {
+                   int ihaha2 = ((event[ptstdau[hh]]).id());
                    if(ihaha2<0) ihaha2*=-1;
                    int ihaha =pdgNum[ihaha2];
-		if(idbg>1)  std::cout<<" adding stable particle "<<ptalldau[hh]<<" with id "<<ihaha2<<" and pdgNum "<<ihaha <<" "<<partNames[ihaha]<<std::endl;
-		 }
+		   std::cout<<" adding stable particle "<<ptstdau[hh]<<" with id "<<ihaha2<<" and pdgNum "<<ihaha <<" "<<partNames[ihaha]<<std::endl;
 	      }
 	    }
-            hnfstdau->Fill( nfstdau );
+            plots->hnfstdau->Fill( nfstdau );
  
 
-	    isize = ptstdau.size();
 	    for(int hh=0;hh<isize;hh++) {
-	      //std::cout<<"check "<<partNames[pdgNum[pythia.event[ptstdau[hh]].id()]]<<" "<<pdgNum[pythia.event[ptstdau[hh]].id()]<<" "<<pythia.event[ptstdau[hh]].id()<<std::endl;
-	      if( (pdgNum[pythia.event[ptstdau[hh]].id()]<0)||
-                  (pdgNum[pythia.event[ptstdau[hh]].id()]>=npart-1)) {
-		  std::cout<<"unknown stable "<<pythia.event[ptstdau[hh]].id()<<std::endl;
+	      //std::cout<<"check "<<partNames[pdgNum[event[ptstdau[hh]].id()]]<<" "<<pdgNum[event[ptstdau[hh]].id()]<<" "<<event[ptstdau[hh]].id()<<std::endl;
+	      if( (pdgNum[event[ptstdau[hh]].id()]<0)||
+                  (pdgNum[event[ptstdau[hh]].id()]>=npart-1)) {
+		  std::cout<<"unknown stable "<<event[ptstdau[hh]].id()<<std::endl;
 	    } else {
-	      hdaupt->Fill(pythia.event[ptstdau[hh]].pT());
-	      hdecays2->Fill(partNames[pdgNum[abs(pythia.event[ptstdau[hh]].id())]],1);
+	      plots->hdaupt->Fill(event[ptstdau[hh]].pT());
+	      plots->hdecays2->Fill(partNames[pdgNum[abs(event[ptstdau[hh]].id())]],1);
 	    }
 	    }
 
@@ -478,50 +913,50 @@ std::cout<<"now making stable daughters"<<std::endl;
       }  // end if an HV
 
       // look at stable, charged particles
-      if (pythia.event[i].isFinal() && pythia.event[i].isCharged()!=0) {  // count if stable and charged and output to display file
+      if (event[i].isFinal() && event[i].isCharged()!=0) {  // count if stable and charged and output to display file
         ++nCharged;
 	
-	if(idsp>0) outPut<<pythia.event[i].id()<<" "<<
-		     pythia.event[i].xProd()<<" "<<
-		     pythia.event[i].yProd()<<" "<<
-		     pythia.event[i].zProd()<<" "<<
-		     pythia.event[i].px()<<" "<<
-		     pythia.event[i].py()<<" "<<
-		     pythia.event[i].pz()<<" "<<
+	if(idsp>0) outPut<<event[i].id()<<" "<<
+		     event[i].xProd()<<" "<<
+		     event[i].yProd()<<" "<<
+		     event[i].zProd()<<" "<<
+		     event[i].px()<<" "<<
+		     event[i].py()<<" "<<
+		     event[i].pz()<<" "<<
 	  endl;
 	
       }
       //look at stable and neutral
-      if (pythia.event[i].isFinal() && pythia.event[i].isCharged()==0) // count if stable and neutral
+      if (event[i].isFinal() && event[i].isCharged()==0) // count if stable and neutral
         ++nNeutral;
 
       //look at all stable particles
-      if(pythia.event[i].isFinal()) {  // if stable
-	hppid->Fill( pythia.event[i].id() );  // get the type of the particle
+      if(event[i].isFinal()) {  // if stable
+	plots->hppid->Fill( event[i].id() );  // get the type of the particle
 	nTot=nTot+1;  //count
-	//	cout<<"   id px py pz e "<<pythia.event[i].id()<<" "<<pythia.event[i].px()<<" "<<pythia.event[i].py()<<" "<<pythia.event[i].pz()<<" "<<pythia.event[i].e()<<std::endl;
+	//	cout<<"   id px py pz e "<<event[i].id()<<" "<<event[i].px()<<" "<<event[i].py()<<" "<<event[i].pz()<<" "<<event[i].e()<<std::endl;
       }
 
 
     }  // end particle list loop 
     // Fill charged multiplicity in histogram. End event loop.
-    hmultch->Fill( nCharged );
-    hmultneu->Fill( nNeutral );
-    hndpis->Fill( ndpis );
-    hndqs->Fill( ndqs );
-    hndq71->Fill( ndq71 );
-    hndqnm->Fill( ndqnm );
+    plots->hmultch->Fill( nCharged );
+    plots->hmultneu->Fill( nNeutral );
+    plots->hndpis->Fill( ndpis );
+    plots->hndqs->Fill( ndqs );
+    plots->hndq71->Fill( ndq71 );
+    plots->hndqnm->Fill( ndqnm );
 
 
     if(idbg>0) {
       cout<<"will robinson"<<endl;
       cout<<"number dark quarks without dark quark mothers is "<<ndqnm<<endl;
       cout<<" pointers to dark quarks are "<<dq1<<" "<<dq2<<endl;
-      cout<<" pt y phi are "<<pythia.event[dq1].pT()<<" "<<pythia.event[dq1].y()<<" "<<pythia.event[dq1].phi()<<endl;
-      cout<<" pt y phi are "<<pythia.event[dq2].pT()<<" "<<pythia.event[dq2].y()<<" "<<pythia.event[dq2].phi()<<endl;
+      cout<<" pt y phi are "<<event[dq1].pT()<<" "<<event[dq1].y()<<" "<<event[dq1].phi()<<endl;
+      cout<<" pt y phi are "<<event[dq2].pT()<<" "<<event[dq2].y()<<" "<<event[dq2].phi()<<endl;
       cout<<" pointers to d quarks are "<<d1<<" "<<d2<<endl;
-      cout<<" pt y phi are "<<pythia.event[d1].pT()<<" "<<pythia.event[d1].y()<<" "<<pythia.event[d1].phi()<<endl;
-      cout<<" pt y phi are "<<pythia.event[d2].pT()<<" "<<pythia.event[d2].y()<<" "<<pythia.event[d2].phi()<<endl;
+      cout<<" pt y phi are "<<event[d1].pT()<<" "<<event[d1].y()<<" "<<event[d1].phi()<<endl;
+      cout<<" pt y phi are "<<event[d2].pT()<<" "<<event[d2].y()<<" "<<event[d2].phi()<<endl;
       cout<<endl;
       cout<<" number dark quarks code 71 is "<<ndq71<<endl;
     }
@@ -530,44 +965,36 @@ std::cout<<"now making stable daughters"<<std::endl;
       cout<<" information about dark pions"<<endl;
       cout<<" number of dark pions is "<<ndpis<<endl;
       cout<<" id mother1 mother2 daughter 1 daughter2 pt y phi"<<endl;
-      for(int jj=0;jj<ndpis;++jj) {
+      for(int jj=0;jj<ndpis && jj<ndpismax;++jj) {
 	int kk = ptdpis[jj];
-	 cout<<kk<<" "<<pythia.event[kk].id()<<" "<<pythia.event[kk].mother1()<<" "<<pythia.event[kk].mother2()<<" "<<
-	  pythia.event[kk].daughter1()<<" "<<pythia.event[kk].daughter2()<<" "<<
-        pythia.event[kk].pT()<<" "<<pythia.event[kk].y()<<" "<<pythia.event[kk].phi()<<" "<<endl;
+	 cout<<kk<<" "<<event[kk].id()<<" "<<event[kk].mother1()<<" "<<event[kk].mother2()<<" "<<
+	  event[kk].daughter1()<<" "<<event[kk].daughter2()<<" "<<
+        event[kk].pT()<<" "<<event[kk].y()<<" "<<event[kk].phi()<<" "<<endl;
 
       }
     }
 
 
     // compare code 71 dark quarks to initial dark quarks
-    float a1=abs(pythia.event[dq1].phi()-pythia.event[dq711].phi());
-    if(a1>3.14159) a1=6.2832-a1;
-    a1=sqrt(pow(pythia.event[dq1].y()-pythia.event[dq711].y(),2)+pow(a1,2));
-    float b1=abs(pythia.event[dq1].phi()-pythia.event[dq712].phi());
-    if(b1>3.14159) b1=6.2832-b1;
-    b1=sqrt(pow(pythia.event[dq1].y()-pythia.event[dq712].y(),2)+pow(b1,2));
+    float a1=DeltaR(event[dq1].y(),event[dq1].phi(),event[dq711].y(),event[dq711].phi());
+    float b1=DeltaR(event[dq1].y(),event[dq1].phi(),event[dq712].y(),event[dq712].phi());
     if(a1<b1) {
-      hdRdqdq71->Fill(a1);
-      hpTdqdq71->Fill(pythia.event[dq1].pT(),pythia.event[dq711].pT());
+      plots->hdRdqdq71->Fill(a1);
+      plots->hpTdqdq71->Fill(event[dq1].pT(),event[dq711].pT());
     } else {
-      hdRdqdq71->Fill(b1);
-      hpTdqdq71->Fill(pythia.event[dq1].pT(),pythia.event[dq712].pT());
+      plots->hdRdqdq71->Fill(b1);
+      plots->hpTdqdq71->Fill(event[dq1].pT(),event[dq712].pT());
     }
 
 
-    a1=abs(pythia.event[dq2].phi()-pythia.event[dq711].phi());
-    if(a1>3.14159) a1=6.2832-a1;
-    a1=sqrt(pow(pythia.event[dq2].y()-pythia.event[dq711].y(),2)+pow(a1,2));
-    b1=abs(pythia.event[dq2].phi()-pythia.event[dq712].phi());
-    if(b1>3.14159) b1=6.2832-b1;
-    b1=sqrt(pow(pythia.event[dq2].y()-pythia.event[dq712].y(),2)+pow(b1,2));
+    a1=DeltaR(event[dq2].y(),event[dq2].phi(),event[dq711].y(),event[dq711].phi());
+    b1=DeltaR(event[dq2].y(),event[dq2].phi(),event[dq712].y(),event[dq712].phi());
     if(a1<b1) {
-      hdRdqdq71->Fill(a1);
-      hpTdqdq71->Fill(pythia.event[dq2].pT(),pythia.event[dq711].pT());
+      plots->hdRdqdq71->Fill(a1);
+      plots->hpTdqdq71->Fill(event[dq2].pT(),event[dq711].pT());
     } else {
-      hdRdqdq71->Fill(b1);
-      hpTdqdq71->Fill(pythia.event[dq2].pT(),pythia.event[dq712].pT());
+      plots->hdRdqdq71->Fill(b1);
+      plots->hpTdqdq71->Fill(event[dq2].pT(),event[dq712].pT());
     }
 
 
@@ -578,18 +1005,18 @@ std::cout<<"now making stable daughters"<<std::endl;
 
     //get kinematic variables for initial dark quarks and d quarks
 
-    dq1pT=pythia.event[dq1].pT();
-    dq1y=pythia.event[dq1].y();
-    dq1phi=pythia.event[dq1].phi();
-    dq2pT=pythia.event[dq2].pT();
-    dq2y=pythia.event[dq2].y();
-    dq2phi=pythia.event[dq2].phi();
-    d1pT=pythia.event[d1].pT();
-    d1y=pythia.event[d1].y();
-    d1phi=pythia.event[d1].phi();
-    d2pT=pythia.event[d2].pT();
-    d2y=pythia.event[d2].y();
-    d2phi=pythia.event[d2].phi();
+    dq1pT=event[dq1].pT();
+    dq1y=event[dq1].y();
+    dq1phi=event[dq1].phi();
+    dq2pT=event[dq2].pT();
+    dq2y=event[dq2].y();
+    dq2phi=event[dq2].phi();
+    d1pT=event[d1].pT();
+    d1y=event[d1].y();
+    d1phi=event[d1].phi();
+    d2pT=event[d2].pT();
+    d2y=event[d2].y();
+    d2phi=event[d2].phi();
 
     // delta r between dark quark and d quark
     //    float bbb=99999.;
@@ -612,72 +1039,40 @@ std::cout<<"now making stable daughters"<<std::endl;
 
 
     // analyze jets
-    hnjet->Fill( aSlowJet.sizeJet() );
+    plots->hnjet->Fill( aSlowJet.sizeJet() );
     if(idbg>0) aSlowJet.list();
-    if(aSlowJet.sizeJet()>0)  hjet1pT->Fill(aSlowJet.pT(0));
-    if(aSlowJet.sizeJet()>1)  hjet2pT->Fill(aSlowJet.pT(1));
-    if(aSlowJet.sizeJet()>2)  hjet3pT->Fill(aSlowJet.pT(2));
-    if(aSlowJet.sizeJet()>3)  hjet4pT->Fill(aSlowJet.pT(3));
-
-    // set up counters for number of dark pions in each jet and number of jets with at least one dark pion
-    vector<int> ndqinjet(aSlowJet.sizeJet());
-    for(int ii=0; ii<aSlowJet.sizeJet(); ii++) { ndqinjet[ii]=0;}
-
+    if(aSlowJet.sizeJet()>0)  plots->hjet1pT->Fill(aSlowJet.pT(0));
+    if(aSlowJet.sizeJet()>1)  plots->hjet2pT->Fill(aSlowJet.pT(1));
+    if(aSlowJet.sizeJet()>2)  plots->hjet3pT->Fill(aSlowJet.pT(2));
+    if(aSlowJet.sizeJet()>3)  plots->hjet4pT->Fill(aSlowJet.pT(3));
+
+    // jets and dark pions as (y, phi) arrays for the matching
+    EtaPhiPoints &jetPts = buf.jetPts, &dpiPts = buf.dpiPts;
+    jetPts.clear();
+    dpiPts.clear();
     for (int ijet =0; ijet< aSlowJet.sizeJet(); ++ijet) {
-      hjetpT->Fill(aSlowJet.pT(ijet));
-      hjety->Fill(aSlowJet.y(ijet));
-      hjetphi->Fill(aSlowJet.phi(ijet));
-
-      // find number of dark quarks in jet
-      for(int ll=0;ll<ndpis;++ll) {
-        aaatmp=abs(pythia.event[ptdpis[ll]].phi()-aSlowJet.phi(ijet));
-        if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-        aaatmp=sqrt(pow(pythia.event[ptdpis[ll]].y()-aSlowJet.y(ijet),2)+pow(aaatmp,2));
-	if(aaatmp<0.4) {
-	  ndqinjet[ijet]=ndqinjet[ijet]+1;
-	}
-      }
-
-
-
-      // find delta R to dq1
-      aaatmp=abs(dq1phi-aSlowJet.phi(ijet));
-      if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-      aaatmp=sqrt(pow(dq1y-aSlowJet.y(ijet),2)+pow(aaatmp,2));
-      if(aaatmp<dq1dR) {
-	dq1dR=aaatmp;
-	dq1sj=ijet;
-      }
+      plots->hjetpT->Fill(aSlowJet.pT(ijet));
+      plots->hjety->Fill(aSlowJet.y(ijet));
+      plots->hjetphi->Fill(aSlowJet.phi(ijet));
+      jetPts.push_back(aSlowJet.y(ijet),aSlowJet.phi(ijet),aSlowJet.pT(ijet));
+    }
+    for(int ll=0;ll<ndpis && ll<ndpismax;++ll) {
+      dpiPts.push_back(event[ptdpis[ll]].y(),event[ptdpis[ll]].phi(),event[ptdpis[ll]].pT());
+    }
 
-      // find delta R to dq2
-      aaatmp=abs(dq2phi-aSlowJet.phi(ijet));
-      if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-      aaatmp=sqrt(pow(dq2y-aSlowJet.y(ijet),2)+pow(aaatmp,2));
-      if(aaatmp<dq2dR) {
-	dq2dR=aaatmp;
-	dq2sj=ijet;
-      }
-      // find delta R to d1
-      aaatmp=abs(d1phi-aSlowJet.phi(ijet));
-      //      cout<<d1phi<<" "<<aSlowJet.phi(ijet)<<" "<<aaatmp<<endl;
-      if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-      //      cout<<d1y<<" "<<aSlowJet.y(ijet)<<endl;
-      aaatmp=sqrt(pow(d1y-aSlowJet.y(ijet),2)+pow(aaatmp,2));
-      //      cout<<" ijet "<<ijet<<" aaatmp "<<aaatmp<<" d1dR "<<d1dR<<endl;
-      if(aaatmp<d1dR) {
-	d1dR=aaatmp;
-	d1sj=ijet;
-      }
-      // find delta R to d2
-      aaatmp=abs(d2phi-aSlowJet.phi(ijet));
-      if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-      aaatmp=sqrt(pow(d2y-aSlowJet.y(ijet),2)+pow(aaatmp,2));
-      if(aaatmp<d2dR) {
-	d2dR=aaatmp;
-	d2sj=ijet;
-      }
+    // number of dark pions in each jet
+    vector<int> &ndqinjet = buf.ndqinjet;
+    ndqinjet.assign(aSlowJet.sizeJet(),0);
+    for(int ijet=0; ijet<aSlowJet.sizeJet(); ijet++) {
+      ndqinjet[ijet]=CountWithinCone(jetPts.eta[ijet],jetPts.phi[ijet],dpiPts,0.4);
+    }
 
-    }  // end loop over slow jets
+    // closest jet to the dark quarks and d quarks
+    int k;
+    if((k=NearestMatch(dq1y,dq1phi,jetPts,dq1dR))>=0) dq1sj=k;
+    if((k=NearestMatch(dq2y,dq2phi,jetPts,dq2dR))>=0) dq2sj=k;
+    if((k=NearestMatch(d1y,d1phi,jetPts,d1dR))>=0) d1sj=k;
+    if((k=NearestMatch(d2y,d2phi,jetPts,d2dR))>=0) d2sj=k;
 
 
     if(idbg>0) {
@@ -687,16 +1082,16 @@ std::cout<<"now making stable daughters"<<std::endl;
       cout<<" slow jet matching to d2 is "<<d2sj<<endl;
     }
 
-      hdRdqj->Fill(dq1dR);
-      hdRdqj->Fill(dq2dR);
+      plots->hdRdqj->Fill(dq1dR);
+      plots->hdRdqj->Fill(dq2dR);
 
-      hdRdj->Fill(d1dR);
-      hdRdj->Fill(d2dR);
+      plots->hdRdj->Fill(d1dR);
+      plots->hdRdj->Fill(d2dR);
 
-      hdqvjet->Fill(pythia.event[dq1].pT(),aSlowJet.pT(dq1sj));
-      hdqvjet->Fill(pythia.event[dq2].pT(),aSlowJet.pT(dq2sj));
-      float Del1 = (pythia.event[dq1].pT()-aSlowJet.pT(dq1sj))/aSlowJet.pT(dq1sj);
-      float Del2 = (pythia.event[dq2].pT()-aSlowJet.pT(dq2sj))/aSlowJet.pT(dq2sj);
+      plots->hdqvjet->Fill(event[dq1].pT(),aSlowJet.pT(dq1sj));
+      plots->hdqvjet->Fill(event[dq2].pT(),aSlowJet.pT(dq2sj));
+      float Del1 = (event[dq1].pT()-aSlowJet.pT(dq1sj))/aSlowJet.pT(dq1sj);
+      float Del2 = (event[dq2].pT()-aSlowJet.pT(dq2sj))/aSlowJet.pT(dq2sj);
       //      if( (Del1>0.5&&aSlowJet.pT(dq1sj)<60) || (Del2>0.5&&aSlowJet.pT(dq2sj)<60) ) {
       //	cout<<"danger danger will robinson Del1 Del2 are "<<Del1<<" "<<Del2<<endl;
       //      }
@@ -712,126 +1107,43 @@ std::cout<<"now making stable daughters"<<std::endl;
     if(idbg>0) cout<<" information about dark pions per jet"<<endl;
     for (int ijet =0; ijet< aSlowJet.sizeJet(); ++ijet) {
 	if( (ijet==d1sj) || (ijet==d2sj) ) {
-	  hndpipjd->Fill(ndqinjet[ijet]);
+	  plots->hndpipjd->Fill(ndqinjet[ijet]);
 	}
       if(ndqinjet[ijet]>0) {
 	njetdpi=njetdpi+1;
-	hndpipj->Fill(ndqinjet[ijet]);
-	hptjetdp->Fill(aSlowJet.pT(ijet));
+	plots->hndpipj->Fill(ndqinjet[ijet]);
+	plots->hptjetdp->Fill(aSlowJet.pT(ijet));
 	if( (ijet!=dq1sj)&& (ijet!=dq2sj) ) {
-	  hndpipjndq->Fill(ndqinjet[ijet]);
-  	  hptjetdpndq->Fill(aSlowJet.pT(ijet));
+	  plots->hndpipjndq->Fill(ndqinjet[ijet]);
+  	  plots->hptjetdpndq->Fill(aSlowJet.pT(ijet));
 	} else {
-	  hndpipjdq->Fill(ndqinjet[ijet]);
-  	  hptjetdpdq->Fill(aSlowJet.pT(ijet));
+	  plots->hndpipjdq->Fill(ndqinjet[ijet]);
+  	  plots->hptjetdpdq->Fill(aSlowJet.pT(ijet));
 	}
       }
       if(idbg>0) {
 	cout<<ijet<<" "<<ndqinjet[ijet]<<endl;
       }
     }
-    hnjetdpi->Fill(njetdpi);
+    plots->hnjetdpi->Fill(njetdpi);
 
 
     // find delta R between dark pions and dark quarts
-    for (int ii =0; ii< ndpis; ++ii) {
-      int ipt = ptdpis[ii];
-      // find delta R to dq1
-      aaatmp=abs(dq1phi-pythia.event[ipt].phi());
-      if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-      aaatmp=sqrt(pow(dq1y-pythia.event[ipt].y(),2)+pow(aaatmp,2));
-      // find delta R to dq2
-      aaatmp2=abs(dq2phi-pythia.event[ipt].phi());
-      if(aaatmp2>3.14159) aaatmp2=6.2832-aaatmp2;
-      aaatmp2=sqrt(pow(dq2y-pythia.event[ipt].y(),2)+pow(aaatmp2,2));
+    EtaPhiPoints &dqPts = buf.dqPts;
+    dqPts.clear();
+    dqPts.push_back(dq1y,dq1phi,dq1pT);
+    dqPts.push_back(dq2y,dq2phi,dq2pT);
+    for (int ii =0; ii< (int)dpiPts.size(); ++ii) {
       //take minimum
-      if(aaatmp2<aaatmp) aaatmp=aaatmp2;
-      //      if(aaatmp>2) cout<<"danger danger will robinson aaatmp large"<<endl;
-      hdRdpisdjet->Fill(aaatmp);
+      NearestMatch(dpiPts.eta[ii],dpiPts.phi[ii],dqPts,aaatmp);
+      plots->hdRdpisdjet->Fill(aaatmp);
     }
 
 
     // for each dark quark, output daughter tree until hit stable particle
-    // dark quark 1
-    //    cout<<endl;
-    if(idbg>0) cout<<"beginning dark quark 1 "<<dq1<<endl;
-    int ipt = dq1;
-    //get number of daughters
-    vector<int> dpts1;
-    vector<bool> indq1(pythia.event.size());
-    indq1[ipt]=true;
-    int nd = pythia.event[ipt].daughter2()-pythia.event[ipt].daughter1()+1;
-    for(int kk=0;kk<nd;++kk){
-      indq1[pythia.event[ipt].daughter1()+kk]=true;
-      dpts1.push_back(pythia.event[ipt].daughter1()+kk);
-    }
-
-      
-    while(dpts1.size()>0) {
-      ipt=dpts1[0];
-      dpts1.erase(dpts1.begin());
-      nd = pythia.event[ipt].daughter2()-pythia.event[ipt].daughter1()+1;
-      for(int kk=0;kk<nd;++kk){
-	if( (pythia.event[pythia.event[ipt].daughter1()+kk].isFinal()==false)&&
-	    (abs(pythia.event[pythia.event[ipt].daughter1()+kk].id())>4900000)
-	   ) {
-          dpts1.push_back(pythia.event[ipt].daughter1()+kk);
-	  indq1[pythia.event[ipt].daughter1()+kk]=true;
-	}
-      }
-    }
-    if(idbg>0) cout<<" id mothers daughters pt y phi deltaR"<<endl;
-    for(int kk=0;kk<pythia.event.size();++kk) {
-      if(indq1[kk]) {
-	aaatmp=abs(dq1phi-pythia.event[kk].phi());
-        if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-        aaatmp=sqrt(pow(dq1y-pythia.event[kk].y(),2)+pow(aaatmp,2));
-
-        if(idbg>0) cout<<kk<<" "<<pythia.event[kk].id()<<" "<<pythia.event[kk].mother1()<<" "<<pythia.event[kk].mother2()<<" "<<
-	  pythia.event[kk].daughter1()<<" "<<pythia.event[kk].daughter2()<<" "<<
-        pythia.event[kk].pT()<<" "<<pythia.event[kk].y()<<" "<<pythia.event[kk].phi()<<" "<<aaatmp<<endl;
-      }
-    }
-    
-    // dark quark 2
-    //    cout<<endl;
-    if(idbg>0) cout<<"beginning dark quark 2 "<<dq2<<endl;
-    ipt = dq2;
-    //get number of daughters
-    vector<int> dpts2;
-    vector<bool> indq2(pythia.event.size());
-    indq2[ipt]=true;
-    nd = pythia.event[ipt].daughter2()-pythia.event[ipt].daughter1()+1;
-    for(int kk=0;kk<nd;++kk){
-      indq2[pythia.event[ipt].daughter1()+kk]=true;
-      dpts2.push_back(pythia.event[ipt].daughter1()+kk);
-    }
-
-      
-    while(dpts2.size()>0) {
-      ipt=dpts2[0];
-      dpts2.erase(dpts2.begin());
-      nd = pythia.event[ipt].daughter2()-pythia.event[ipt].daughter1()+1;
-      for(int kk=0;kk<nd;++kk){
-	if( (pythia.event[pythia.event[ipt].daughter1()+kk].isFinal()==false)&&
-	    (abs(pythia.event[pythia.event[ipt].daughter1()+kk].id())>4900000)
-	   ) {
-          dpts2.push_back(pythia.event[ipt].daughter1()+kk);
-	  indq2[pythia.event[ipt].daughter1()+kk]=true;
-	}
-      }
-    }
-    if(idbg>0) cout<<" id mothers daughters pt y phi deltaR"<<endl;
-    for(int kk=0;kk<pythia.event.size();++kk) {
-      if(indq2[kk]) {
-	aaatmp=abs(dq2phi-pythia.event[kk].phi());
-        if(aaatmp>3.14159) aaatmp=6.2832-aaatmp;
-        aaatmp=sqrt(pow(dq2y-pythia.event[kk].y(),2)+pow(aaatmp,2));
-
-        if(idbg>0) cout<<kk<<" "<<pythia.event[kk].id()<<" "<<pythia.event[kk].mother1()<<" "<<pythia.event[kk].mother2()<<" "<<
-	  pythia.event[kk].daughter1()<<" "<<pythia.event[kk].daughter2()<<" "<<
-        pythia.event[kk].pT()<<" "<<pythia.event[kk].y()<<" "<<pythia.event[kk].phi()<<" "<<aaatmp<<endl;
-      }
+    if(idbg>0) {
+      PrintDarkQuarkTree(1, dq1, dq1y, dq1phi, event, graph);
+      PrintDarkQuarkTree(2, dq2, dq2y, dq2phi, event, graph);
     }
     
 
@@ -844,139 +1156,456 @@ std::cout<<"now making stable daughters"<<std::endl;
     for (int ijet =0; ijet< trigSlowJet.sizeJet(); ++ijet) {
       trigHT=trigHT+trigSlowJet.pT(ijet);
     }
-    htright->Fill(trigHT);
+    plots->htright->Fill(trigHT);
 
     // event selection
     int icut =0;
     bool pass = true;
 
-    hcutflow->Fill(icut+0.5); icut++;// all events
+    plots->hcutflow->Fill(icut+0.5); icut++;// all events
 
-    if(trigHT>800) hcutflow->Fill(icut+0.5); icut++;  //trigger
+    if(trigHT>800) plots->hcutflow->Fill(icut+0.5); icut++;  //trigger
 
     if(aSlowJet.sizeJet()>0) {
       if(aSlowJet.pT(0)>400) {
-	if(pass) hcutflow->Fill(icut+0.5); icut++;
+	if(pass) plots->hcutflow->Fill(icut+0.5); icut++;
       }  else {
 	pass=false;
       }
     }
     if(aSlowJet.sizeJet()>1) {
       if(aSlowJet.pT(1)>200) {
-	if(pass) hcutflow->Fill(icut+0.5); icut++;
+	if(pass) plots->hcutflow->Fill(icut+0.5); icut++;
       }  else {
 	pass=false;
       }
     }
     if(aSlowJet.sizeJet()>2) {
       if(aSlowJet.pT(2)>125) {
-	if(pass) hcutflow->Fill(icut+0.5); icut++;
+	if(pass) plots->hcutflow->Fill(icut+0.5); icut++;
       }  else {
 	pass=false;
       }
     }
     if(aSlowJet.sizeJet()>3) {
       if(aSlowJet.pT(3)>50) {
-	if(pass) hcutflow->Fill(icut+0.5);icut++;
+	if(pass) plots->hcutflow->Fill(icut+0.5);icut++;
       }  else {
 	pass=false;
       }
     }
 
-    
-    if(ihepMCout>0) {  // write hepMCoutput file
-      HepMC::GenEvent* hepmcevt = new HepMC::GenEvent();
-      ToHepMC.fill_next_event( pythia, hepmcevt );
-    
-      // Write the HepMC event to file. Done with it.                                               //                     
-      ascii_io << hepmcevt;
-      delete hepmcevt;
-    
+    // the trigger and the four jet cuts together
+    if(trigHT>800 && aSlowJet.sizeJet()>3 && aSlowJet.pT(0)>400 && aSlowJet.pT(1)>200 &&
+       aSlowJet.pT(2)>125 && aSlowJet.pT(3)>50) plots->hcutflow->Fill(6.5);
+}
+
+
+// state of one generator thread
+// stages of the event loop timed with Main:timing
+enum { kStageEvent, kStageNext, kStageGraph, kStageJets, kStageAnalysis,
+       kStageConvert, kStageWait, kStageWrite, kStageDelphes, kNStages };
+const char *stageNames[kNStages] = {
+  "event", "next", "event_graph", "jets", "analysis",
+  "hepmc_convert", "wait_turn", "hepmc_write", "delphes"
+};
+
+
+struct Worker
+{
+  Pythia *pythia;
+  HVPlots *plots;
+  StageTimer *timer;
+  const PdgIndex *pdgNum;  // shared, read only
+};
+
+
+// what the workers write to; only touched in the writing turn
+struct SharedOutput
+{
+  EventSequencer sequencer;
+  HepMC::IO_GenEvent *ascii_io;  // null without HepMC output
+  PythiaDelphes *delphes;        // null without in-process Delphes
+  int nWritten;
+  ofstream *outPut;
+  CheckpointBarrier *barrier;    // null without checkpoints
+};
+
+
+// generate the events iWorker, iWorker+nWorkers, ... of the run
+void RunWorker(Worker *worker, int iWorker, int nWorkers, int firstEvent, int nEvent, SharedOutput *out)
+{
+  Pythia &pythia = *worker->pythia;
+
+  // one anti-kT clustering of the visible particles for both jet collections
+  AntiKtJets jets(0.4,35.,3.0,2,1); // R, ptjetmin, etamax, which particle, mass
+  JetView aSlowJet(jets,35.,2.5);   // analysis jets: ptjetmin, |y| max
+  JetView trigSlowJet(jets,40.);    // trigger jets
+
+  HepMC::Pythia8ToHepMC ToHepMC;
+  GenFilter filter(pythia);
+  EventGraph graph;
+  EventBuffers buf;
+  HepMC::GenEvent genEvent;  // reused for every event of the worker
+
+  for (int iEvent = firstEvent+iWorker; iEvent < nEvent; iEvent += nWorkers) {
+    if(out->barrier) out->barrier->Arrive(iEvent-iWorker);
+    if(idsp>0) (*out->outPut)<<"New Event "<<iEvent<<endl;
+    StageTimer &timer = *worker->timer;
+    StageTimer::Scope eventTime(timer, kStageEvent);
+
+    timer.Start(kStageNext);
+    bool generated = pythia.next();
+    timer.Stop(kStageNext);
+    bool accepted = false;
+    bool converted = false;
+    if(generated) {
+      timer.Start(kStageGraph);
+      graph.Build(pythia.event);
+      timer.Stop(kStageGraph);
+
+      // do jet finding for this event
+      timer.Start(kStageJets);
+      jets.analyze(pythia.event);
+      aSlowJet.Update();
+      trigSlowJet.Update();
+      timer.Stop(kStageJets);
+
+      timer.Start(kStageAnalysis);
+      AnalyseEvent(iEvent, pythia.event, graph, aSlowJet, trigSlowJet, worker->plots, *worker->pdgNum, buf, *out->outPut);
+      timer.Stop(kStageAnalysis);
+
+      // the generator-level histograms above see every event, the output only accepted ones
+      double weight = pythia.info.weight();
+      accepted = filter.Pass(aSlowJet, trigSlowJet);
+      worker->plots->hfilter->Fill(0.5);
+      worker->plots->hfilter->Fill(2.5, weight);
+      if(accepted) {
+        worker->plots->hfilter->Fill(1.5);
+        worker->plots->hfilter->Fill(3.5, weight);
+      }
+    }
+    if(accepted) {
+      if(ihepMCout>0) {  // convert to hepMC outside of the writing turn
+        timer.Start(kStageConvert);
+        genEvent.clear();
+        ToHepMC.fill_next_event( pythia, &genEvent );
+        converted = true;
+        timer.Stop(kStageConvert);
+      }
     }
-    
 
+    // every event number gets a turn, even if generation aborted
+    timer.Start(kStageWait);
+    out->sequencer.Wait(iEvent);
+    timer.Stop(kStageWait);
+    if(accepted) {
+      if(converted) {
+        // Write the HepMC event to file.
+        timer.Start(kStageWrite);
+        genEvent.set_event_number(out->nWritten);
+        (*out->ascii_io) << &genEvent;
+        timer.Stop(kStageWrite);
+      }
+      // Delphes is not thread safe, it runs in the turn of the event
+      if(out->delphes) {
+        timer.Start(kStageDelphes);
+        out->delphes->ProcessEvent(pythia, out->nWritten);
+        timer.Stop(kStageDelphes);
+      }
+      out->nWritten++;
+    }
+    out->sequencer.Done();
 
   }  // end loop over events
+  if(out->barrier) out->barrier->Leave();
+}
+
+
+int main(int argc, char* argv[]) {
+
+  Pythia pythia;
+  // Read in commands from external file.
+  string filename = "modelA_res.cmnd";
+  if(argc>1) filename = argv[1];
+  ConfigurePythia(pythia, filename);
+  int nEvent = pythia.mode("Main:numberOfEvents");
+  int nThreads = pythia.mode("Main:numberOfThreads");
+  if(argc>2) nThreads = atoi(argv[2]);
+  if(nThreads<1) nThreads = 1;
+
+  // checkpoints; a job that finds the manifest of an earlier one continues it
+  int ckptEvery = pythia.mode("Main:checkpointEvery");
+  string ckptFile = pythia.word("Main:checkpointFile");
+  if(ckptEvery>0 && pythia.word("Main:delphesCard")!="") {
+    cout << "checkpoints are not supported with the in-process Delphes, switched off" << endl;
+    ckptEvery = 0;
+  }
+  if(ckptEvery>0 && pythia.word("Main:hepmcOutput")!="none" && pythia.word("Main:hepmcFile")=="-") {
+    // stdout is the event stream
+    cerr << "checkpoints are not supported with the HepMC output to stdout, switched off" << endl;
+    ckptEvery = 0;
+  }
+  // every worker must stop at the same round of events
+  if(ckptEvery%nThreads!=0) ckptEvery += nThreads-ckptEvery%nThreads;
+  Checkpoint resume;
+  bool resuming = ckptEvery>0 && resume.Read(ckptFile);
+  if(resuming && resume.nThreads!=nThreads) {
+    cout << ckptFile << " was written with " << resume.nThreads << " threads, run with the same number to resume" << endl;
+    return 1;
+  }
+
+  // open the HepMC output first, it may take over stdout
+  HepMCOutput hepmcOut(pythia, resuming ? resume.hepmcOffset : -1);
+  if(!hepmcOut.Good()) return 1;
+  if(!hepmcOut.Enabled()) ihepMCout = 0;
+  cout << "pythia.readFile(" << filename << ");" << endl;
+
+  // the serial run uses the instance above, the parallel run one instance per
+  // thread with seeds derived from the seed of the card
+  vector<Pythia*> pythias;
+  if(nThreads==1) {
+    pythia.init();
+    pythias.push_back(&pythia);
+  } else {
+    ROOT::EnableThreadSafety();
+    int masterSeed = 19780503;  // the Pythia default
+    if(pythia.flag("Random:setSeed") && pythia.mode("Random:seed")!=0) masterSeed = pythia.mode("Random:seed");
+    if(masterSeed<0) masterSeed = time(0) % 900000000;
+    cout << "running " << nThreads << " threads with master seed " << masterSeed << endl;
+    for(int iw=0;iw<nThreads;iw++) {
+      Pythia *wpythia = new Pythia();
+      ConfigurePythia(*wpythia, filename);
+      // the stride keeps workers of runs with neighbouring master seeds apart
+      int seed = (masterSeed + iw*104729) % 900000000;
+      if(seed==0) seed = 1;
+      wpythia->readString("Random:setSeed = on");
+      wpythia->readString("Random:seed = "+to_string(seed));
+      if(iw>0) {
+        wpythia->readString("Init:showChangedSettings = off");
+        wpythia->readString("Init:showChangedParticleData = off");
+        wpythia->readString("Next:numberCount = 0");
+        wpythia->readString("Next:numberShowInfo = 0");
+        wpythia->readString("Next:numberShowProcess = 0");
+        wpythia->readString("Next:numberShowEvent = 0");
+      }
+      wpythia->init();
+      pythias.push_back(wpythia);
+    }
+    if(idsp>0) {
+      cout << "event display file is only written in the serial mode" << endl;
+      idsp = 0;
+    }
+  }
+  int firstEvent = 0;
+  if(resuming) {
+    firstEvent = resume.nextEvent;
+    cout << "resuming from " << ckptFile << " at event " << firstEvent << endl;
+    for(int iw=0;iw<nThreads;iw++) {
+      if(!pythias[iw]->rndm.readState(Checkpoint::DataName(ckptFile,firstEvent,".rndm"+to_string(iw)))) {
+        cout << "cannot read the random number state of the checkpoint" << endl;
+        return 1;
+      }
+    }
+  }
+
+  // Create the ROOT application environment.
+  TApplication theApp("hist", &argc, argv);
+
+  // Create file on which histogram(s) can be saved.
+  TFile* outFile = new TFile("PythiaOutput.root", "RECREATE");
+  // histograms are written explicitly, and worker copies must not clash by name
+  TH1::AddDirectory(kFALSE);
+
+
+  // create a file for the event display
+  ofstream outPut;
+  if(idsp>0) outPut.open("forDisplay.txt");
+  if(idsp>0) outPut<<" pid x0 y0 z0 px py pz"<<endl;
+
+
+
+unordered_map<int,int> pdgNum;
+
+ pdgNum.emplace(11,0);
+ pdgNum.emplace(12,1);
+ pdgNum.emplace(13,2);
+ pdgNum.emplace(14,3);
+pdgNum.emplace(211,4);
+pdgNum.emplace(321,5);
+pdgNum.emplace(1114,6);
+pdgNum.emplace(2112,7);
+pdgNum.emplace(2212,8);
+ pdgNum.emplace(22,9);
+ pdgNum.emplace(130,10);
+
+
+for(int hh=0;hh<1000;hh++) {
+  auto got2 = pdgNum.find(hh);
+  if(got2 == pdgNum.end()) pdgNum.emplace(hh,npart-1);
+ }
+  PdgIndex pdgIndex(pdgNum);
+
+
+  // Book histogram.
+  HVPlots *plots = new HVPlots;
+  // a resumed serial run gets the prefilled entries back from the checkpoint
+  BookHistograms(plots, !(resuming && nThreads==1));
+
+  bool timing = pythia.flag("Main:timing");
+  vector<Worker> workers(nThreads);
+  for(int iw=0;iw<nThreads;iw++) {
+    workers[iw].pythia = pythias[iw];
+    workers[iw].timer = new StageTimer(stageNames, kNStages, timing);
+    workers[iw].pdgNum = &pdgIndex;
+    if(nThreads==1) {
+      workers[iw].plots = plots;
+    } else {
+      workers[iw].plots = new HVPlots;
+      BookHistograms(workers[iw].plots, false);
+    }
+  }
+  vector<HVPlots*> workerPlots;
+  for(int iw=0;iw<nThreads;iw++) workerPlots.push_back(workers[iw].plots);
+  if(resuming && !LoadCheckpointHistograms(Checkpoint::DataName(ckptFile,firstEvent,".root"), workerPlots)) {
+    cout << "cannot read the histograms of the checkpoint" << endl;
+    return 1;
+  }
+
+
+  // Begin event loop. Generate event; skip if generation aborted.
+
+  cout<<"test test"<<endl;
+
+  // run the detector simulation in the same job if a Delphes card is given
+  PythiaDelphes *delphes = 0;
+  if(pythia.word("Main:delphesCard")!="") {
+    delphes = new PythiaDelphes;
+    if(!delphes->Init(pythia.word("Main:delphesCard"), pythia.word("Main:delphesFile"))) return 1;
+  }
+
+  SharedOutput out;
+  out.ascii_io = ihepMCout>0 ? hepmcOut.IO() : 0;
+  out.delphes = delphes;
+  out.nWritten = resuming ? resume.nWritten : 0;
+  out.outPut = &outPut;
+  out.sequencer.Start(firstEvent);
+
+  // accepted events and cross section of each worker, including the
+  // part of the run before the checkpoint
+  vector<long> nAccepted(nThreads, 0);
+  vector<double> sigmaGen(nThreads, 0.);
+  auto updateSigma = [&]() {
+    for(int iw=0;iw<nThreads;iw++) {
+      long nPrev = resuming ? resume.nAccepted[iw] : 0;
+      double sPrev = resuming ? resume.sigmaGen[iw] : 0.;
+      long nNow = pythias[iw]->info.nAccepted();
+      nAccepted[iw] = nPrev+nNow;
+      sigmaGen[iw] = nAccepted[iw]>0 ? (sPrev*nPrev+pythias[iw]->info.sigmaGen()*nNow)/nAccepted[iw] : 0.;
+    }
+  };
+
+  // called with all workers stopped before event iEvent
+  Checkpoint saved = resume;
+  auto saveCheckpoint = [&](int iEvent) {
+    Checkpoint ck;
+    ck.nextEvent = iEvent;
+    ck.nWritten = out.nWritten;
+    ck.nThreads = nThreads;
+    ck.hepmcOffset = ihepMCout>0 ? hepmcOut.Offset() : -1;
+    updateSigma();
+    ck.nAccepted = nAccepted;
+    ck.sigmaGen = sigmaGen;
+    SaveCheckpointHistograms(Checkpoint::DataName(ckptFile,iEvent,".root"), workerPlots);
+    for(int iw=0;iw<nThreads;iw++) {
+      pythias[iw]->rndm.dumpState(Checkpoint::DataName(ckptFile,iEvent,".rndm"+to_string(iw)));
+    }
+    if(!ck.Write(ckptFile)) {
+      cout << "cannot write " << ckptFile << endl;
+      return;
+    }
+    if(saved.nThreads>0) saved.Remove(ckptFile);
+    saved = ck;
+    cout << "checkpoint at event " << iEvent << endl;
+  };
+  CheckpointBarrier *barrier = 0;
+  if(ckptEvery>0) barrier = new CheckpointBarrier(ckptEvery, firstEvent, nThreads, saveCheckpoint);
+  out.barrier = barrier;
+
+  chrono::steady_clock::time_point loopStart = chrono::steady_clock::now();
+  if(nThreads==1) {
+    RunWorker(&workers[0], 0, 1, firstEvent, nEvent, &out);
+  } else {
+    vector<thread> threads;
+    for(int iw=0;iw<nThreads;iw++) {
+      threads.push_back(thread(RunWorker, &workers[iw], iw, nThreads, firstEvent, nEvent, &out));
+    }
+    for(int iw=0;iw<nThreads;iw++) threads[iw].join();
+
+    MergeHistograms(plots, workerPlots);
+  }
+  double loopTime = chrono::duration<double>(chrono::steady_clock::now()-loopStart).count();
+
+  if(timing) {
+    StageTimer total(stageNames, kNStages, true);
+    for(int iw=0;iw<nThreads;iw++) total.Add(*workers[iw].timer);
+    cout << "time per stage, summed over " << nThreads << " thread(s), event loop " << loopTime << " s" << endl;
+    total.Print(cout);
+    total.WriteJSON("PythiaOutput_timing.json", loopTime, nEvent-firstEvent, nThreads);
+  }
 
 
   // close file for display
   if(idsp>0)  outPut.close();
+  hepmcOut.Close();
+  if(delphes) delete delphes;
 
   // Statistics on event generation.
-  pythia.stat();
+  for(int iw=0;iw<nThreads;iw++) pythias[iw]->stat();
+
+  // the cross section of the written sample is sigmaGen times the filter efficiency
+  updateSigma();
+  // weighted by the accepted events of each worker, as in updateSigma
+  double sigmaGenAll = 0.;
+  long nAcceptedAll = 0;
+  for(int iw=0;iw<nThreads;iw++) {
+    sigmaGenAll += sigmaGen[iw]*nAccepted[iw];
+    nAcceptedAll += nAccepted[iw];
+  }
+  if(nAcceptedAll>0) sigmaGenAll /= nAcceptedAll;
+  double sumwGen = plots->hfilter->GetBinContent(3);
+  double sumwAcc = plots->hfilter->GetBinContent(4);
+  double filterEff = sumwGen>0 ? sumwAcc/sumwGen : 0.;
+  plots->hfilter->SetBinContent(5,sigmaGenAll);
+  plots->hfilter->SetBinContent(6,sigmaGenAll*filterEff);
+  cout << "generator filter: accepted " << plots->hfilter->GetBinContent(2) << " of "
+       << plots->hfilter->GetBinContent(1) << " events, efficiency " << filterEff
+       << ", accepted cross section " << sigmaGenAll*filterEff << " mb" << endl;
 
 
   // Save histogram on file and close file.
-  hdppt->Write();
-  hdRdqdq71->Write();
-  hpTdqdq71->Write();
-  hdqvjet->Write();
-  hnjetdpi->Write();
-  hndpipj->Write();
-  hndpipjndq->Write();
-  hndpipjdq->Write();
-  hndpipjd->Write();
-  hptjetdp->Write();
-  hptjetdpndq->Write();
-  hptjetdpdq->Write();
-  hdRdpisdjet->Write();
-  htright->Write();
-  hcutflow->Write();
-  hdRdqj->Write();
-  hdRdj->Write();
-  hppid2ddg->Write();
-  hndpis->Write();
-  hndqs->Write();
-  hndq71->Write();
-  hndqnm->Write();
-  hmultch->Write();
-  hmultneu->Write();
-  hppid->Write();
-  hppidHV->Write();
-  hppid2HV->Write();
-  hmassHV->Write();
-  hqHV->Write();
-  hmHV->Write();
-  hm2HV->Write();
-  hd0HV->Write();
-  hd0gHV->Write();
-  ht0HV->Write();
-  hd0dHV->Write();
-  hd0d2HV->Write();
-  hstatus->Write();
-  hstatus2->Write();
-  hndau->Write();
-  hnsdau->Write();
-  hd0HVs1->Write();
-  hndau2->Write();
-  hnjet->Write();
-  hjetpT->Write();
-  hjet1pT->Write();
-  hjet2pT->Write();
-  hjet3pT->Write();
-  hjet4pT->Write();
-  hjety->Write();
-  hjetphi->Write();
-
-  
-  hdecays->LabelsDeflate();
-  hdecays->LabelsOption("v");
-  hdecays->LabelsOption("a");
-  hdecays->Write();
-
-
-  hdecays2->LabelsDeflate();
-  hdecays2->LabelsOption("v");
-  hdecays2->LabelsOption("a");
-  hdecays2->Write();
-  
-  hdaupt->Write();
-  hmapt->Write();
-  hnfstdau->Write();
-  hnfrstdau->Write();
+  outFile->cd();
+  WriteHistograms(plots);
+  WriteParameters(pythia, filename, sigmaGenAll, sigmaGenAll*filterEff);
 
   delete outFile;
 
+  // the run is complete, the checkpoint is not needed any more
+  if(barrier) {
+    delete barrier;
+    if(saved.nThreads>0) {
+      saved.Remove(ckptFile);
+      remove(ckptFile.c_str());
+    }
+  }
+  for(int iw=0;iw<nThreads;iw++) delete workers[iw].timer;
+  if(nThreads>1) {
+    for(int iw=0;iw<nThreads;iw++) {
+      delete workers[iw].plots;
+      delete pythias[iw];
+    }
+  }
+
   // Done.
   return 0;
 }
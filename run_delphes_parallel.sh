@@ -0,0 +1,134 @@
+#!/bin/bash -e
+
+# Delphes on one HepMC file with several DelphesHepMC at the same time. The
+# file must be block-compressed and indexed (HepMCIndex.h): the gzip output
+# of pythiaTree is, other files (e.g. the MadGraph tag_1_pythia8_events.hepmc.gz)
+# are first copied into that form with hepmcIndex.exe build. The events are
+# split in ranges, each range is read by hepmcIndex.exe extract and simulated
+# by its own DelphesHepMC, and the outputs are added in event order.
+
+case `uname` in
+	Linux) ECHO="echo -e" ;;
+	*) ECHO="echo" ;;
+esac
+
+usage() {
+	$ECHO "run_delphes_parallel.sh [options]"
+	$ECHO
+	$ECHO "Options:"
+	$ECHO "-i            \tHepMC file (gzip or plain)"
+	$ECHO "-o            \toutput name (default = input name), the output is [name].root"
+	$ECHO "-D            \tDelphes card (default = delphes_card_CMS_imp.tcl)"
+	$ECHO "-j            \tDelphes running at the same time (default = number of cores)"
+	$ECHO "-n            \tnumber of event ranges (default = -j)"
+	$ECHO "-k            \tkeep the output of every range, [name]_delphes/part_NNNN.root"
+	$ECHO "-h            \tdisplay this message and exit"
+	exit $1
+}
+
+SCRIPTDIR=$(dirname $(readlink -f $0))
+INPUT=""
+NAME=""
+DELPHESCARD=$PWD/delphes_card_CMS_imp.tcl
+NJOBS=$(nproc)
+NRANGES=""
+KEEP=""
+RANGE=""
+
+# check arguments (-x range runs a single range, for the local jobs)
+while getopts "i:o:D:j:n:kx:h" opt; do
+	case "$opt" in
+	i) INPUT=$(readlink -f $OPTARG)
+	;;
+	o) NAME=$OPTARG
+	;;
+	D) DELPHESCARD=$(readlink -f $OPTARG)
+	;;
+	j) NJOBS=$OPTARG
+	;;
+	n) NRANGES=$OPTARG
+	;;
+	k) KEEP=yes
+	;;
+	x) RANGE=$OPTARG
+	;;
+	h) usage 0
+	;;
+	esac
+done
+
+if [ -z "$INPUT" ] || [ ! -e "$INPUT" ]; then
+	usage 1
+fi
+if [ -z "$NAME" ]; then
+	NAME=$(basename $INPUT)
+	NAME=${NAME%.gz}
+	NAME=${NAME%.hepmc}
+	NAME=${NAME%.out}
+fi
+if [ -z "$NRANGES" ]; then
+	NRANGES=$NJOBS
+fi
+INDEXER=$SCRIPTDIR/hepmcIndex.exe
+OUTDIR=$PWD/${NAME}_delphes
+
+# one range: events [first, last) into part_NNNN.root
+if [ -n "$RANGE" ]; then
+	set -o pipefail
+	LINE=($(grep "^$RANGE " $OUTDIR/ranges.txt))
+	PART=$OUTDIR/part_${RANGE}.root
+	rm -f $PART
+	if $INDEXER extract $INPUT ${LINE[1]} ${LINE[2]} 2> $OUTDIR/extract_${RANGE}.log | \
+	   DelphesHepMC $DELPHESCARD $PART > $OUTDIR/delphes_${RANGE}.log 2>&1; then
+		$ECHO "range $RANGE done: events ${LINE[1]} to ${LINE[2]}"
+	else
+		$ECHO "range $RANGE failed, see $OUTDIR/delphes_${RANGE}.log"
+		exit 1
+	fi
+	exit 0
+fi
+
+if [ ! -x $INDEXER ]; then
+	$ECHO "$INDEXER not found (make hepmcIndex)"
+	exit 1
+fi
+
+# an indexed copy of files without an index
+if ! $INDEXER info $INPUT > /dev/null 2>&1; then
+	INDEXED=$PWD/${NAME}_indexed.hepmc.gz
+	if ! $INDEXER info $INDEXED > /dev/null 2>&1; then
+		$ECHO "indexing $INPUT into $INDEXED"
+		$INDEXER build $INPUT $INDEXED $NJOBS
+	fi
+	INPUT=$INDEXED
+fi
+NEVENTS=$($INDEXER info $INPUT | awk '{ print $2 }')
+if [ -z "$NEVENTS" ] || [ "$NEVENTS" -eq 0 ]; then
+	$ECHO "no events in $INPUT"
+	exit 1
+fi
+$ECHO "$INPUT: $NEVENTS events in $NRANGES ranges, $NJOBS at a time"
+
+rm -rf $OUTDIR
+mkdir -p $OUTDIR
+# the remainder goes to the first ranges
+awk -v n=$NEVENTS -v r=$NRANGES 'BEGIN { first = 0; for(i=0;i<r;i++) { m = int(n/r) + (i < n%r ? 1 : 0); if(m>0) printf "%04d %d %d\n", i, first, first+m; first += m } }' > $OUTDIR/ranges.txt
+
+STATUS=0
+awk '{ print $1 }' $OUTDIR/ranges.txt | \
+	xargs -P $NJOBS -I{} $SCRIPTDIR/run_delphes_parallel.sh -i $INPUT -o $NAME -D $DELPHESCARD -x {} || STATUS=1
+if [ $STATUS -ne 0 ]; then
+	$ECHO "Delphes failed on some ranges, see $OUTDIR"
+	exit 1
+fi
+
+# hadd keeps the order of its inputs, so the events are in the order of the HepMC file
+hadd -f ${NAME}.root $(awk -v d=$OUTDIR '{ printf "%s/part_%s.root ", d, $1 }' $OUTDIR/ranges.txt)
+if [ -z "$KEEP" ]; then
+	rm -rf $OUTDIR
+fi
+
+$ECHO "Delphes output: ${NAME}.root"
+$ECHO "End of job"
+
+exit 0
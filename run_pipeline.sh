@@ -0,0 +1,198 @@
+#!/bin/bash -e
+
+# Generation, detector simulation and analysis of one sample as concurrent
+# stages. The generator writes HepMC into a fifo; the events are cut into
+# chunks, each simulated by DelphesHepMC as soon as it is complete, and each
+# Delphes chunk is analysed by emgD.exe while the next ones are simulated.
+# The fifo and the bounded analysis queue hold back the faster stages, so no
+# intermediate HepMC file is written.
+
+case `uname` in
+	Linux) ECHO="echo -e" ;;
+	*) ECHO="echo" ;;
+esac
+
+usage() {
+	$ECHO "run_pipeline.sh [options]"
+	$ECHO
+	$ECHO "Options:"
+	$ECHO "-s            \tsignal: pythiaTree card"
+	$ECHO "-t            \tsignal: number of pythiaTree threads (default = card)"
+	$ECHO "-p            \tbackground: process name for bkg_generation.sh"
+	$ECHO "-d            \tbackground: directory of premade cards (default = $PWD/mg5cards)"
+	$ECHO "-c            \tbackground: custom card name (default = process name)"
+	$ECHO "-o            \toutput name (default = card or custom name)"
+	$ECHO "-D            \tDelphes card (default = delphes_card_CMS_imp.tcl)"
+	$ECHO "-n            \tevents per Delphes chunk (default = 1000)"
+	$ECHO "-q            \tchunks waiting for the analysis before Delphes waits (default = 4)"
+	$ECHO "-a            \tanalysis executable, none to skip (default = ./emgD.exe)"
+	$ECHO "-h            \tdisplay this message and exit"
+	exit $1
+}
+
+SIGCARD=""
+NTHREADS=""
+PROCNAME=""
+CARDSDIR=$PWD/mg5cards
+CUSTOMCARD=""
+NAME=""
+DELPHESCARD=$PWD/delphes_card_CMS_imp.tcl
+NCHUNK=1000
+MAXQUEUE=4
+ANALYSIS=$PWD/emgD.exe
+
+# check arguments
+while getopts "s:t:p:d:c:o:D:n:q:a:h" opt; do
+	case "$opt" in
+	s) SIGCARD=$OPTARG
+	;;
+	t) NTHREADS=$OPTARG
+	;;
+	p) PROCNAME=$OPTARG
+	;;
+	d) CARDSDIR=$OPTARG
+	;;
+	c) CUSTOMCARD=$OPTARG
+	;;
+	o) NAME=$OPTARG
+	;;
+	D) DELPHESCARD=$(readlink -f $OPTARG)
+	;;
+	n) NCHUNK=$OPTARG
+	;;
+	q) MAXQUEUE=$OPTARG
+	;;
+	a) ANALYSIS=$OPTARG
+	;;
+	h) usage 0
+	;;
+	esac
+done
+
+if [ -z "$SIGCARD" ] && [ -z "$PROCNAME" ]; then
+	usage 1
+fi
+if [ -z "$CUSTOMCARD" ]; then
+	CUSTOMCARD=$PROCNAME
+fi
+if [ -z "$NAME" ]; then
+	if [ -n "$SIGCARD" ]; then
+		NAME=$(basename $SIGCARD .cmnd)
+	else
+		NAME=$CUSTOMCARD
+	fi
+fi
+if [ "$ANALYSIS" != "none" ]; then
+	if [ ! -x "$ANALYSIS" ]; then
+		$ECHO "$ANALYSIS not found (make emgD), running without analysis"
+		ANALYSIS=none
+	else
+		ANALYSIS=$(readlink -f $ANALYSIS)
+	fi
+fi
+
+# the Delphes chunks go to ${NAME}_delphes, the analysis of each chunk to ${NAME}_results
+WORKDIR=$PWD/pipeline_${NAME}
+OUTDIR=$PWD/${NAME}_delphes
+RESDIR=$PWD/${NAME}_results
+rm -rf $WORKDIR $OUTDIR $RESDIR
+mkdir -p $WORKDIR/queue $OUTDIR $RESDIR
+# MadGraph requires this extension for its fifo
+FIFO=$WORKDIR/events.hepmc.fifo
+
+# stage 1: generation into the fifo
+if [ -n "$SIGCARD" ]; then
+	mkfifo $FIFO
+	# the events to stdout, the printout to stderr
+	cp $SIGCARD $WORKDIR/pipeline.cmnd
+	$ECHO "\nMain:hepmcOutput = ascii\nMain:hepmcFile = -" >> $WORKDIR/pipeline.cmnd
+	./pythiaTree.exe $WORKDIR/pipeline.cmnd $NTHREADS > $FIFO 2> $WORKDIR/generation.log &
+	GENPID=$!
+else
+	# MadGraph creates the fifo itself
+	./bkg_generation.sh -p $PROCNAME -d $CARDSDIR -c $CUSTOMCARD -f $FIFO > $WORKDIR/generation.log 2>&1 &
+	GENPID=$!
+	while [ ! -p $FIFO ]; do
+		if ! kill -0 $GENPID 2> /dev/null; then
+			$ECHO "generation stopped before writing events, see $WORKDIR/generation.log"
+			exit 1
+		fi
+		sleep 5
+	done
+fi
+
+# stage 2: the events are cut in chunks of NCHUNK, each piped into its own
+# DelphesHepMC with the header and footer of the stream; the name of every
+# finished chunk is passed on to the analysis, and a new chunk only starts
+# when fewer than MAXQUEUE are waiting for it
+DELPHES_AWK='
+function waitqueue(  cmd, n) {
+	if(analysis=="none") return
+	while(1) {
+		cmd = "ls " work "/queue | wc -l"
+		cmd | getline n
+		close(cmd)
+		if(n+0 < maxq) return
+		system("sleep 1")
+	}
+}
+function start() {
+	waitqueue()
+	nchunk++
+	chunk = sprintf("%s/chunk_%04d", outdir, nchunk)
+	delphes = "DelphesHepMC " card " " chunk ".root > " work "/delphes_" nchunk ".log 2>&1"
+	printf "%s", header | delphes
+	nev = 0
+	inchunk = 1
+}
+function finish() {
+	print "HepMC::IO_GenEvent-END_EVENT_LISTING" | delphes
+	if(close(delphes)!=0) {
+		print "DelphesHepMC failed on " chunk ", see " work "/delphes_" nchunk ".log" > "/dev/stderr"
+		failed = 1
+	}
+	if(analysis!="none") system(sprintf("touch %s/queue/%04d", work, nchunk))
+	print chunk ".root"
+	fflush()
+	inchunk = 0
+}
+/^HepMC::Version/ || /START_EVENT_LISTING/ { header = header $0 "\n"; next }
+/END_EVENT_LISTING/ { next }
+/^E / { if(inchunk && nev>=nchunkev) finish(); if(!inchunk) start(); nev++ }
+{ if(inchunk) print | delphes }
+END { if(inchunk) finish(); exit failed }
+'
+
+# stage 3: the analysis of each chunk as it comes; a failed Delphes chunk
+# (the status of the awk) or a failed analysis fails the pipeline, so that
+# no partial results are added
+set -o pipefail
+STATUS=0
+awk -v work=$WORKDIR -v outdir=$OUTDIR -v card=$DELPHESCARD -v nchunkev=$NCHUNK -v maxq=$MAXQUEUE -v analysis=$ANALYSIS "$DELPHES_AWK" < $FIFO | {
+	FAILED=""
+	while read CHUNK; do
+		$ECHO "Delphes done: $CHUNK"
+		if [ "$ANALYSIS" != "none" ]; then
+			BASE=$(basename $CHUNK .root)
+			(cd $WORKDIR && $ANALYSIS -o $RESDIR/results_${BASE}.root $CHUNK > analysis_${BASE}.log 2>&1) || { $ECHO "analysis of $CHUNK failed"; FAILED=yes; }
+			rm -f $WORKDIR/queue/${BASE#chunk_}
+		fi
+	done
+	[ -z "$FAILED" ]
+} || STATUS=1
+
+wait $GENPID || STATUS=1
+if [ $STATUS -ne 0 ]; then
+	$ECHO "pipeline failed, see the logs in $WORKDIR"
+	exit 1
+fi
+
+# the analysis of the whole sample
+if [ "$ANALYSIS" != "none" ]; then
+	hadd -f results_${NAME}.root $RESDIR/results_chunk_*.root
+fi
+
+$ECHO "Delphes output: $OUTDIR/chunk_*.root"
+$ECHO "End of job"
+
+exit 0
@@ -0,0 +1,159 @@
+#!/bin/bash -e
+
+# Scan of the signal model parameters: every point of the grid is the base
+# card with the scanned parameters set, run by pythiaTree in its own
+# directory; the points are run -j at a time. Each PythiaOutput.root keeps
+# the model parameters, the cross section and the card (see WriteParameters
+# in pythiaTree.cc), and scanSummary.C collects the cross sections and cut
+# flows of all points in one table.
+
+case `uname` in
+	Linux) ECHO="echo -e" ;;
+	*) ECHO="echo" ;;
+esac
+
+usage() {
+	$ECHO "signal_scan.sh [options]"
+	$ECHO
+	$ECHO "Options:"
+	$ECHO "-c            \tbase card (default = modelA_res.cmnd)"
+	$ECHO "-g            \tscanned parameter and values, repeat for each axis, e.g."
+	$ECHO "              \t-g 4900001:m0=1000,1500,2000 -g 4900111:tau0=1,10,150"
+	$ECHO "              \tnames joined by + get the same value, e.g. 4900101:m0+HiddenValley:Lambda=5,10,20"
+	$ECHO "-n            \tevents per point (default = card)"
+	$ECHO "-t            \tpythiaTree threads per point (default = 1)"
+	$ECHO "-j            \tpoints run at the same time (default = number of cores / threads)"
+	$ECHO "-o            \tscan name (default = card name), the points go to scan_[name]"
+	$ECHO "-e            \tpythiaTree executable (default = ./pythiaTree.exe)"
+	$ECHO "-s            \tonly write the summary of an existing scan"
+	$ECHO "-h            \tdisplay this message and exit"
+	exit $1
+}
+
+SCRIPTDIR=$(dirname $(readlink -f $0))
+BASECARD=modelA_res.cmnd
+AXES=()
+NEVENTS=""
+NTHREADS=1
+NJOBS=""
+NAME=""
+EXE=$PWD/pythiaTree.exe
+SUMMARY=""
+POINT=""
+
+# check arguments (-x point runs a single point, for the local jobs)
+while getopts "c:g:n:t:j:o:e:sx:h" opt; do
+	case "$opt" in
+	c) BASECARD=$OPTARG
+	;;
+	g) AXES+=($OPTARG)
+	;;
+	n) NEVENTS=$OPTARG
+	;;
+	t) NTHREADS=$OPTARG
+	;;
+	j) NJOBS=$OPTARG
+	;;
+	o) NAME=$OPTARG
+	;;
+	e) EXE=$(readlink -f $OPTARG)
+	;;
+	s) SUMMARY=yes
+	;;
+	x) POINT=$OPTARG
+	;;
+	h) usage 0
+	;;
+	esac
+done
+
+if [ -z "$NAME" ]; then
+	NAME=$(basename $BASECARD .cmnd)
+fi
+if [ -z "$NJOBS" ]; then
+	NJOBS=$(($(nproc)/NTHREADS))
+	if [ $NJOBS -lt 1 ]; then NJOBS=1; fi
+fi
+SCANDIR=$PWD/scan_${NAME}
+POINTS=$SCANDIR/points.txt
+
+# one point, in scan_[name]/point_NNNN
+if [ -n "$POINT" ]; then
+	cd $SCANDIR/point_$POINT
+	rm -f DONE FAILED
+	if $EXE point.cmnd $NTHREADS > pythiaTree.log 2>&1; then
+		touch DONE
+		$ECHO "point $POINT done"
+	else
+		touch FAILED
+		$ECHO "point $POINT failed, see $SCANDIR/point_$POINT/pythiaTree.log"
+		exit 1
+	fi
+	exit 0
+fi
+
+if [ -z "$SUMMARY" ]; then
+	if [ ${#AXES[@]} -eq 0 ] || [ ! -e "$BASECARD" ]; then
+		usage 1
+	fi
+	if [ ! -x "$EXE" ]; then
+		$ECHO "$EXE not found (make pythiaTree)"
+		exit 1
+	fi
+
+	# the grid: every combination of the values of the axes, as
+	# "name=value name=value ..." per point
+	GRID=("")
+	for AXIS in ${AXES[@]}; do
+		NAMES=${AXIS%%=*}
+		VALUES=${AXIS#*=}
+		NEWGRID=()
+		for P in "${GRID[@]}"; do
+			for V in ${VALUES//,/ }; do
+				Q="$P"
+				for N in ${NAMES//+/ }; do
+					Q="$Q $N=$V"
+				done
+				NEWGRID+=("${Q# }")
+			done
+		done
+		GRID=("${NEWGRID[@]}")
+	done
+
+	rm -rf $SCANDIR
+	mkdir -p $SCANDIR
+	cp $BASECARD $SCANDIR/base.cmnd
+	echo "# point parameters" > $POINTS
+	for ((i=0; i < ${#GRID[@]}; i++)); do
+		POINT=$(printf "%04d" $i)
+		mkdir -p $SCANDIR/point_$POINT
+		echo "$POINT ${GRID[$i]}" >> $POINTS
+		# later settings win, so the scanned values are appended to the base card
+		CARD=$SCANDIR/point_$POINT/point.cmnd
+		cp $BASECARD $CARD
+		$ECHO "\n! scan point $POINT" >> $CARD
+		for P in ${GRID[$i]}; do
+			echo "${P%%=*} = ${P#*=}" >> $CARD
+		done
+		if [ -n "$NEVENTS" ]; then
+			echo "Main:numberOfEvents = $NEVENTS" >> $CARD
+		fi
+	done
+	$ECHO "${#GRID[@]} points, $NJOBS at a time"
+
+	awk '!/^#/ { print $1 }' $POINTS | \
+		xargs -P $NJOBS -I{} $SCRIPTDIR/signal_scan.sh -o $NAME -e $EXE -t $NTHREADS -x {} || \
+		$ECHO "some points failed, see $SCANDIR"
+fi
+
+# the table of all points
+if [ ! -e $POINTS ]; then
+	$ECHO "no scan in $SCANDIR"
+	exit 1
+fi
+root -l -b -q "$SCRIPTDIR/scanSummary.C(\"$SCANDIR\")"
+
+$ECHO "summary: $SCANDIR/summary.txt"
+$ECHO "End of job"
+
+exit 0